@@ -4,6 +4,18 @@
 typedef	uint8_t oled_intensity_t;
 typedef int16_t oled_pos_t;
 typedef	uint8_t oled_align_t;
+typedef struct oled_canvas_s oled_canvas_t;
+typedef struct oled_region_s oled_region_t;
+typedef struct oled_chart_s oled_chart_t;
+typedef struct
+{
+	uint32_t frames;	/* updates sent */
+	uint32_t deferred;	/* updates held back by frame rate or bus budget */
+	uint32_t bytes;		/* data bytes sent */
+	uint32_t busy_us;	/* time spent sending updates, including waiting for the bus, bytes*1000000/busy_us is throughput */
+	uint32_t chunks;	/* SPI data transactions */
+	uint32_t chunk_us;	/* longest data transaction, i.e. the most another device on the bus waits */
+} oled_stats_t;
 
 #define	OLED_T	0x01	/* top align */
 #define	OLED_M	0x03	/* middle align */
@@ -14,21 +26,63 @@ typedef	uint8_t oled_align_t;
 #define	OLED_R	0x20	/* right align */
 #define	OLED_H	0x80	/* horizontal move */
 
+#define	OLED_EVENODD	0	/* polygon fill rule */
+#define	OLED_NONZERO	1	/* polygon fill rule */
+#define	OLED_POLY_MAX	32	/* max polygon points */
+
+#define	OLED_SUB_BITS	4
+#define	OLED_SUB	(1<<OLED_SUB_BITS)	/* antialiased drawing positions are in 1/OLED_SUB pixels */
+
 /* Set up SPI, and start the update task */
 const char*oled_start (int8_t port, int8_t cs,int8_t clk,int8_t din,int8_t dc,int8_t rst,int8_t flip);
+/* Add another panel (CONFIG_OLED_PANELS), showing the viewport at x/y, e.g. 128,0 for a second panel on the right with a 256 wide frame buffer, clk/din only used if a different port, do a lock first */
+/* only panels with changes are sent, panels on different ports send at the same time, panels sharing dc must be on the same port, no rotation */
+const char*oled_panel(int8_t port,int8_t cs,int8_t clk,int8_t din,int8_t dc,oled_pos_t x,oled_pos_t y);
 
 /* locking atomic drawing functions */
-void oled_lock(void);	/* sets default state to 0, 0, left, top, horizontal, white on black */
+void oled_lock(void);	/* sets default state to 0, 0, left, top, horizontal, white on black, no dither, not transparent, drawing on display, no clip */
 void oled_unlock(void);
 
-/* Overall display contrast setting */
-void oled_set_contrast(oled_intensity_t);
+/* Display register settings, these send only the register concerned, not the frame buffer */
+void oled_set_contrast(oled_intensity_t);	/* Master contrast (0xC7, SSD1331 0x87) */
+void oled_set_channel_contrast(uint8_t a,uint8_t b,uint8_t c);	/* Contrast of colours A, B, C (0xC1, SSD1331 0x81-0x83), default 0x8A, 0x51, 0x8A (SSD1331 0x80), scaled by oled_fade() */
+void oled_set_precharge(uint8_t voltage,uint8_t period);	/* Pre-charge voltage (0xBB, 0-31, default 0x17), second pre-charge period (0xB6, 0-15, default 8, SSD1331 0x8A-0x8C speed) */
+
+/* Update scheduling, defaults CONFIG_OLED_FPS, CONFIG_OLED_LATENCY, CONFIG_OLED_BUS_DUTY */
+void oled_schedule(uint16_t fps,uint16_t latency,uint8_t duty);	/* Max updates per second, ms to hold changes so drawing is combined, max percent of time spent sending */
+void oled_stats(oled_stats_t*,uint8_t reset);	/* Get (and optionally reset) update stats */
+void oled_bus(uint16_t chunk,uint8_t priority);	/* Max bytes per SPI transaction (0 for CONFIG_OLED_CHUNK, which is also the most allowed) so a shared bus is free between them, update task priority (0 for unchanged), defaults CONFIG_OLED_CHUNK, CONFIG_OLED_PRIORITY */
+
+/* Power */
+void oled_sleep(void);	/* Display off and low power, drawing carries on in the frame buffer but nothing is sent */
+void oled_wake(void);	/* Display on, sends the area drawn on while asleep */
+
+/* Effects, done by display registers so no frame buffer data is sent, run by the update task */
+#define	OLED_NORMAL	0xA6	/* display mode */
+#define	OLED_INVERSE	0xA7	/* display mode */
+#define	OLED_ALL_OFF	0xA4	/* display mode */
+#define	OLED_ALL_ON	0xA5	/* display mode */
+void oled_fade(oled_intensity_t level,uint32_t ms);	/* Fade colour contrast to level (255 is normal, 0 is dark) over ms (at most about 71 minutes) */
+void oled_set_mode(uint8_t mode);	/* Set display mode, OLED_NORMAL, etc, stops blink */
+void oled_blink(uint8_t mode,uint32_t ms,uint8_t count);	/* Alternate between display mode and mode every ms, count flashes, 0 for until stopped, ms 0 to stop, at most about 71 minutes */
+
+/* Rotation, done by the display controller so nothing needs redrawing, 0/90/180/270 clockwise (90/270 only if square), oled_start flip is 180 */
+void oled_rotate(uint16_t deg);
+
+/* Part of frame buffer shown, if CONFIG_OLED_VIRTUAL_WIDTH/HEIGHT are bigger than the display - do a lock first */
+void oled_viewport(oled_pos_t x,oled_pos_t y);	/* Set top left of display in frame buffer, vertical moves only send rows that come in to view */
 
 /* Drawing functions - do a lock first */
 /* State setting */
 void oled_pos(oled_pos_t x,oled_pos_t y,oled_align_t);	/* Set position, not y=0 is TOP of display */
 void oled_colour(char);	/* Set foreground */
 void oled_background(char);	/* Set background */
+void oled_dither(uint8_t);	/* Set ordered (4x4 Bayer) dither of intensity for following drawing, e.g. gradients and antialiased text */
+void oled_transparent(uint8_t);	/* Set transparent, intensity blends foreground over what is already there, background colour not used */
+void oled_select(oled_canvas_t*);	/* Set canvas on which to draw, NULL for display */
+void oled_layer(uint8_t);	/* Set display layer on which to draw, 0 is bottom, same as oled_select(NULL) */
+uint8_t oled_clip_push(oled_pos_t w,oled_pos_t h);	/* Restrict drawing to area at position (within current clip), returns 0 if stack full, select/layer clears clip */
+void oled_clip_pop(void);	/* Undo last oled_clip_push */
 
 /* State get */
 oled_pos_t oled_x(void);
@@ -36,11 +90,47 @@ oled_pos_t oled_y(void);
 oled_align_t oled_a(void);
 char oled_f(void);
 char oled_b(void);
+uint8_t oled_d(void);
+uint8_t oled_t(void);
+void oled_clip_get(oled_pos_t *x,oled_pos_t *y,oled_pos_t *w,oled_pos_t *h);	/* Current clip area, any may be NULL */
 
 /* Drawing */
 void oled_pixel(oled_pos_t x, oled_pos_t y, oled_intensity_t i); /* set pixel directly */
+void oled_pixels(oled_pos_t x,oled_pos_t y,oled_pos_t w,oled_pos_t h,const oled_intensity_t *data,int stride); /* set block of pixels, absolute position like oled_pixel, stride is data per row */
+void oled_pixels_row(oled_pos_t x,oled_pos_t y,oled_pos_t n,const oled_intensity_t *data); /* set n pixels right from x/y */
+void oled_pixels_column(oled_pos_t x,oled_pos_t y,oled_pos_t n,const oled_intensity_t *data); /* set n pixels down from x/y */
 void oled_clear(oled_intensity_t);	/* clear whole display to current colour (intensity 0 means background colour) */
 void oled_box(oled_pos_t w,oled_pos_t h,oled_intensity_t); /* draw a box, not filled */
 void oled_fill(oled_pos_t w,oled_pos_t h,oled_intensity_t); /* draw a filled rectangle */
+void oled_line(oled_pos_t x0,oled_pos_t y0,oled_pos_t x1,oled_pos_t y1,oled_intensity_t); /* draw a line, inclusive, absolute position like oled_pixel */
+void oled_circle(oled_pos_t cx,oled_pos_t cy,oled_pos_t r,oled_intensity_t); /* draw a circle, absolute centre */
+void oled_fill_circle(oled_pos_t cx,oled_pos_t cy,oled_pos_t r,oled_intensity_t); /* draw a filled circle, absolute centre */
+void oled_arc(oled_pos_t cx,oled_pos_t cy,oled_pos_t r,int16_t start,int16_t end,oled_intensity_t); /* draw an arc clockwise from start to end, in degrees clockwise from up */
+void oled_round_box(oled_pos_t w,oled_pos_t h,oled_pos_t r,oled_intensity_t); /* draw a box with corner radius r, not filled */
+void oled_round_fill(oled_pos_t w,oled_pos_t h,oled_pos_t r,oled_intensity_t); /* draw a filled box with corner radius r */
+void oled_polygon(uint8_t n,const oled_pos_t *xy,uint8_t rule,oled_intensity_t,oled_pos_t *box); /* draw filled polygon, n points of x,y pairs (absolute, corners of pixels), OLED_EVENODD/OLED_NONZERO, box (if not NULL) set to x,y,w,h drawn */
+void oled_aa_line(oled_pos_t x0,oled_pos_t y0,oled_pos_t x1,oled_pos_t y1,oled_intensity_t); /* draw an antialiased line, positions in 1/OLED_SUB pixels, blends over what is there */
+void oled_aa_circle(oled_pos_t cx,oled_pos_t cy,oled_pos_t r,oled_intensity_t); /* draw an antialiased circle, positions in 1/OLED_SUB pixels, blends over what is there */
+void oled_scroll_region(oled_pos_t w,oled_pos_t h,oled_pos_t dx,oled_pos_t dy,oled_intensity_t fill); /* move content of an area by dx/dy (+ve is right/down), filling what is exposed */
 void oled_text(int8_t size, const char *fmt,...); /* text, use -ve size for descenders versions */
 void oled_icon16(oled_pos_t w,oled_pos_t h,const void *data);	/* Icon, 16 bit packed */
+void oled_blit565(oled_pos_t w,oled_pos_t h,const void *data);	/* Image, full colour RGB565, big endian, w*h*2 bytes, widened to RGB666 at 18 bits per pixel */
+void oled_image(const void *data);	/* Image, q5 compressed (see tools/oledimage.c), size is in the image */
+void oled_image_direct(const void *data);	/* Image, q5 compressed, sent straight to display not frame buffer after any pending changes, clipped, drawing over it later resends what was underneath, sent at once whatever the frame rate, but counted in stats and the bus budget, drawn to the frame buffer instead while asleep */
+
+/* Canvases - off screen drawing, allocated from CONFIG_OLED_ARENA, do a lock first */
+oled_canvas_t *oled_canvas(oled_pos_t w,oled_pos_t h);	/* Make a canvas (cleared to black), NULL if no space */
+void oled_canvas_free(oled_canvas_t*);	/* Free a canvas, and anything allocated after it */
+void oled_canvas_blit(const oled_canvas_t*,char key);	/* Draw a canvas on the selected canvas/display, key is colour not to draw, or 0 for none */
+
+/* Display layers, CONFIG_OLED_LAYERS, composed bottom up when sent, each layer above 0 showing what is below where it is its key colour */
+void oled_layer_key(uint8_t layer,char key);	/* Set key (transparent) colour for a layer, default is black */
+
+/* Saved regions - e.g. under a popup, allocated from CONFIG_OLED_ARENA, do a lock first */
+oled_region_t *oled_save_region(oled_pos_t w,oled_pos_t h);	/* Save area at position, NULL if no space */
+void oled_restore_region(oled_region_t*);	/* Put back saved area, and free it (and anything allocated after it) */
+
+/* Strip charts - newest sample on right, in current colours, allocated from CONFIG_OLED_ARENA, do a lock first */
+oled_chart_t *oled_chart(oled_pos_t w,oled_pos_t h,int32_t lo,int32_t hi);	/* Make a chart at position on current canvas, lo/hi are values at bottom/top */
+void oled_chart_push(oled_chart_t*,int32_t v,int32_t min,int32_t max);	/* Add sample with min/max envelope (min=max=v for none), scrolls and draws one new column, the whole chart area (w*h*2 bytes, 3 at 18 bits, e.g. 10240 for 128x40, about 4ms at 20MHz) is sent unless the controller can copy it (SSD1331) */
+void oled_chart_draw(oled_chart_t*);	/* Draw whole chart, e.g. when page shown again */
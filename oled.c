@@ -25,6 +25,8 @@ static const char TAG[] = "OLED";
 #include <driver/spi_master.h>
 #include <driver/gpio.h>
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
@@ -100,6 +102,23 @@ static uint8_t const *fonts[] = {
 
 #define WHITE   (RED+GREEN+BLUE)
 
+#elif CONFIG_OLED_BPP == 18
+/* RGB666, worked out 7 bits a colour, as full colour is 2 * IMAX, then halved to 6 bits in oled_rgb() */
+#define ISHIFT  2               /* 6 bits per colour intensity */
+#define R       (1<<14)
+#define G       (1<<7)
+#define B       (1)
+
+#define RED     (R+R)
+#define GREEN   (G+G)
+#define BLUE    (B+B)
+
+#define CYAN    (GREEN+BLUE)
+#define MAGENTA (RED+BLUE)
+#define YELLOW  (RED+GREEN)
+
+#define WHITE   (RED+GREEN+BLUE)
+
 #elif CONFIG_OLED_BPP <= 8
 /* Grey */
 #define WHITE   1
@@ -107,32 +126,196 @@ static uint8_t const *fonts[] = {
 
 #endif
 
-#if CONFIG_OLED_BPP>16
-typedef uint32_t oled_cell_t;
-#define OLEDSIZE (CONFIG_OLED_WIDTH * CONFIG_OLED_HEIGHT * sizeof(oled_cell_t))
+#define	VWIDTH	CONFIG_OLED_VIRTUAL_WIDTH       /* frame buffer size, display shows a viewport in to it */
+#define	VHEIGHT	CONFIG_OLED_VIRTUAL_HEIGHT
+#ifdef	CONFIG_OLED_SSD1331
+#define	GRAM_ROWS	64      /* display RAM rows, a ring using the start line */
+#define	GRAM_COLS	96      /* display RAM columns, the panel is CONFIG_OLED_WIDTH of these from CONFIG_OLED_COL_OFFSET */
+#if CONFIG_OLED_BPP != 16
+#error	SSD1331 is 16 bits per pixel
+#endif
+#else
+#define	GRAM_ROWS	128     /* display RAM rows, a ring using the start line */
+#define	GRAM_COLS	128     /* display RAM columns, the panel is CONFIG_OLED_WIDTH of these from CONFIG_OLED_COL_OFFSET */
+#endif
+
+#if CONFIG_OLED_BPP == 18
+typedef struct __attribute__((packed))
+{                               /* 3 bytes as sent in 262k colour mode, R, G, B, 6 bits each in the low bits */
+   uint8_t c[3];
+} oled_cell_t;
+#define OLEDSIZE (VWIDTH * VHEIGHT * sizeof(oled_cell_t))
+#define	DEPTH	0x80            /* 0xA0 colour depth bits, 262k */
+static inline oled_cell_t oled_rgb(uint32_t v)
+{                               /* colour (7 bits each, 0-126) to cell, so full colour at IMAX is 63 */
+   return (oled_cell_t) { {((v >> 14) + 1) >> 1, (((v >> 7) & 127) + 1) >> 1, ((v & 127) + 1) >> 1} };
+}
+
+static inline oled_cell_t oled_rgb565(uint16_t v)
+{                               /* RGB565 (host order) to cell, 5 bit colours widened to 6 */
+   return (oled_cell_t) { {((v >> 10) & 62) | (v >> 15), (v >> 5) & 63, ((v << 1) & 62) | ((v >> 4) & 1)} };
+}
+
+static inline uint8_t oled_same(oled_cell_t a, oled_cell_t b)
+{                               /* cells equal */
+   return a.c[0] == b.c[0] && a.c[1] == b.c[1] && a.c[2] == b.c[2];
+}
 #elif CONFIG_OLED_BPP>8
 typedef uint16_t oled_cell_t;
-#define OLEDSIZE (CONFIG_OLED_WIDTH * CONFIG_OLED_HEIGHT * sizeof(oled_cell_t))
+#define OLEDSIZE (VWIDTH * VHEIGHT * sizeof(oled_cell_t))
+#define	DEPTH	0x00            /* 0xA0 colour depth bits, 65k */
+#define	oled_rgb(v)	htons(v)        /* RGB565 value to cell, display byte order */
+#define	oled_rgb565(v)	htons(v)
+#define	oled_same(a,b)	((a)==(b))
 #else
 typedef uint8_t oled_cell_t;
-#define OLEDSIZE (CONFIG_OLED_WIDTH * CONFIG_OLED_HEIGHT * CONFIG_OLED_BPP / 8)
+#define OLEDSIZE (VWIDTH * VHEIGHT * CONFIG_OLED_BPP / 8)
 #endif
 static oled_cell_t *oled = NULL;
 
+struct oled_canvas_s
+{                               /* something to draw on */
+   oled_cell_t *cells;          /* w*h cells, row by row */
+   oled_pos_t w,
+    h;
+   /* display layers only */
+   oled_pos_t dirty_l,
+       dirty_t,
+       dirty_r,
+       dirty_b;                 /* area changed since last sent, inclusive, none if r<l */
+   oled_cell_t key;             /* transparent colour, if above layer 0 */
+   uint8_t layer:1;             /* this is a display layer */
+};
+static oled_canvas_t oled_layers[CONFIG_OLED_LAYERS];   /* the display, composed bottom up, layer 0 cells are oled */
+
+static uint8_t *oled_arena = NULL;      /* CONFIG_OLED_ARENA bytes for canvases, allocated and freed as a stack */
+static size_t oled_arena_used = 0;
+
 /* general global stuff */
 static TaskHandle_t oled_task_id = NULL;
 static SemaphoreHandle_t oled_mutex = NULL;
 static int8_t oled_port = 0;
-static int8_t oled_flip = 0;
-static int8_t oled_dc = -1;
+static uint8_t oled_rotation = 0,     /* requested quarter turns clockwise */
+    oled_rotated = 0;           /* quarter turns on the display */
+/* 0xA0 bits, both controllers: 0x01 vertical address increment, 0x02 column remap, 0x04 colour order, 0x10 COM scan reversed, 0x20 COM split, 0xC0 colour depth */
+/* a quarter turn from 0 is vertical increment and one flip, 90 flips columns (0 ^ 0x03), 270 flips COM scan (0 ^ 0x11), a half turn flips both (0 ^ 0x12) */
+#ifdef	CONFIG_OLED_SSD1331
+static const uint8_t oled_remap[4] = { 0x72, 0x71, 0x60, 0x63 };        /* 0xA0 for each rotation, 65k, COM split */
+#define	MODE(m)	((m) & 1 ? (m) : (m) ^ 2)       /* OLED_NORMAL etc are SSD1351 values, SSD1331 has normal and all off swapped */
+#else
+static const uint8_t oled_remap[4] = { DEPTH | 0x26, DEPTH | 0x25, DEPTH | 0x34, DEPTH | 0x37 };        /* 0xA0 for each rotation, 90/270 use vertical address increment */
+#define	MODE(m)	(m)
+#endif
+#define	FLIPPED(bit)	((oled_remap[oled_rotated] ^ oled_remap[0]) & (bit))      /* remap bit differs from unrotated */
+#define	COL_OFFSET	(FLIPPED(0x02) ? GRAM_COLS - CONFIG_OLED_WIDTH - CONFIG_OLED_COL_OFFSET : CONFIG_OLED_COL_OFFSET)     /* first display RAM column of the glass, counted from the other end if columns are remapped */
+#define	ROW_OFFSET	(FLIPPED(0x10) ? GRAM_ROWS - CONFIG_OLED_HEIGHT - CONFIG_OLED_ROW_OFFSET : CONFIG_OLED_ROW_OFFSET)    /* display offset, likewise if COM scan is reversed */
 static int8_t oled_rst = -1;
 static int8_t oled_locks = 0;
-static spi_device_handle_t oled_spi;
 static volatile uint8_t oled_changed = 1;
-static volatile uint8_t oled_update = 0;
+static oled_cell_t oled_buf[512];       /* for sending part rows, used with lock held */
+typedef struct
+{
+   oled_pos_t l,
+    t,
+    r,
+    b;                          /* r/b exclusive */
+} oled_rect_t;
+typedef struct
+{                               /* a display panel, showing part of the viewport */
+   spi_device_handle_t spi;
+   int8_t port,
+    dc;
+   oled_pos_t x,
+    y;                          /* position in viewport */
+   oled_cell_t *buf;            /* for gathering rows, size of oled_buf */
+   spi_transaction_t t;         /* data queued */
+   int64_t start;               /* when queued */
+   oled_pos_t sx,
+    sy,
+    sw,
+    sh;                         /* area of frame buffer still to send, none if sh is 0 */
+   oled_pos_t rows;             /* rows left in display window */
+   oled_pos_t part;             /* cells of the first row already sent, when a chunk is less than a row */
+   oled_rect_t dirty;           /* frame buffer changed where this panel shows it, none if r<=l, only kept with more than one panel */
+   uint8_t ready:1;             /* configured */
+   uint8_t busy:1;              /* data queued */
+} oled_panel_t;
+static oled_panel_t oled_panels[CONFIG_OLED_PANELS];
+static uint8_t oled_npanels = 0;
+static oled_panel_t *panel = NULL;      /* where commands go, NULL for all panels */
+static oled_pos_t oled_disp_w = CONFIG_OLED_WIDTH,
+    oled_disp_h = CONFIG_OLED_HEIGHT;   /* viewport size, covering all panels */
+#define	REG_CONTRAST	1
+#define	REG_CHANNEL	2
+#define	REG_PRECHARGE	4
+#define	REG_FADE	8       /* effects to start, the task owns their state */
+#define	REG_MODE	16
+#define	REG_BLINK	32
+static volatile uint8_t oled_regs = 0; /* display registers to send and effects to start, REG_ bits, set without the lock so updated atomically */
+static volatile uint8_t oled_sleep_req = 0;    /* requested sleep */
+static uint8_t oled_asleep = 0; /* display is asleep, drawing only collects damage */
+static uint32_t oled_frame_us = 1000000 / CONFIG_OLED_FPS,     /* min time between sending changes */
+    oled_latency_us = CONFIG_OLED_LATENCY * 1000;       /* time changes are held to combine them */
+static uint8_t oled_duty = CONFIG_OLED_BUS_DUTY;       /* percentage of time allowed for sending */
+static int64_t oled_due = 0;   /* when pixel changes can next be sent */
+static oled_stats_t oled_stat = { 0 };
+#define	PANELSIZE	(CONFIG_OLED_WIDTH * CONFIG_OLED_HEIGHT * sizeof(oled_cell_t))
+#define	BUS_MAX	(CONFIG_OLED_CHUNK && CONFIG_OLED_CHUNK < PANELSIZE ? CONFIG_OLED_CHUNK : PANELSIZE)      /* largest SPI transaction, a chunk or a whole panel */
+static uint16_t oled_chunk = BUS_MAX;   /* max bytes per SPI transaction */
 static oled_intensity_t oled_contrast = 255;
+/* effects, done with display registers so no pixel data is sent */
+#define	EFFECT_STEP	20000   /* us between fade steps */
+#define	EFFECT_MS_MAX	(UINT32_MAX / 1000)      /* longest fade or blink, as us fit 32 bits */
+#ifdef	CONFIG_OLED_SSD1331
+static uint8_t oled_channel[3] = { 0x80, 0x80, 0x80 }; /* 0x81-0x83 colour contrast, display reset values */
+#else
+static uint8_t oled_channel[3] = { 0x8A, 0x51, 0x8A }; /* 0xC1 colour contrast, display reset values */
+#endif
+static uint8_t oled_precharge_v = 0x17,
+    oled_precharge_t = 0x08;    /* 0xBB pre-charge voltage and 0xB6 second pre-charge period, display reset values */
+static volatile uint8_t oled_fade_req = 255,  /* requested by setters, picked up by the task with REG_ bits */
+    oled_mode_req = 0xA6,
+    oled_blink_mode_req = 0xA7;
+static volatile uint32_t oled_fade_us_req = 0,
+    oled_blink_us_req = 0;
+static volatile int16_t oled_blink_left_req = 0;
+static uint8_t oled_level = 255;        /* fade level, scales colour contrast */
+static uint8_t oled_fade_from = 255,
+    oled_fade_to = 255;
+static int64_t oled_fade_start = 0;     /* esp_timer_get_time() */
+static uint32_t oled_fade_us = 0;       /* fade time, 0 if not fading */
+static uint8_t oled_mode = 0xA6,        /* display mode, normal, inverse, all off, all on */
+    oled_mode_shown = 0xA6;
+static uint8_t oled_blink_mode = 0xA7;  /* mode alternated with oled_mode when blinking */
+static int16_t oled_blink_left = 0;     /* changes of mode to go, -1 for until stopped */
+static uint32_t oled_blink_us = 0;
+static int64_t oled_blink_next = 0;
+static oled_pos_t oled_view_x = 0,
+    oled_view_y = 0;            /* requested viewport */
+static oled_pos_t oled_shown_x = 0,
+    oled_shown_y = 0;           /* viewport on the display */
+static uint8_t oled_gram_top = 0;       /* display RAM row (start line) showing top of viewport */
+#ifdef	CONFIG_OLED_SSD1331
+typedef struct
+{                               /* drawing done by the controller, already done in the frame buffer without damage */
+   uint8_t cmd;                 /* 0x21 line, 0x22 filled rectangle, 0x23 copy */
+   oled_pos_t x,
+    y,
+    w,
+    h;                          /* frame buffer area drawn, or copied from */
+   oled_pos_t dx,
+    dy;                         /* copy, moved by */
+   oled_cell_t c;               /* colour */
+} oled_accel_t;
+#define	ACCEL_MAX	16
+static oled_accel_t oled_accel[ACCEL_MAX];     /* queued in order, sent before pixel data */
+static uint8_t oled_accels = 0;
+static uint8_t oled_gram_differs = 0;  /* display RAM written other than from the frame buffer, so it cannot be copied */
+#define	ACCEL_US(w,h)	(50 + (w) * (h) / 8)   /* no busy signal, allow about 8 pixels a us for the controller to draw */
+#endif
 
 /* drawing state */
+static oled_canvas_t *canvas = &oled_layers[0];        /* where we are drawing */
 static oled_pos_t x = 0,
     y = 0;                      /* position */
 static oled_align_t a = 0;      /* alignment and movement */
@@ -140,6 +323,22 @@ static char f = 0,              /* colour */
     b = 0;
 static uint32_t f_mul = 0,
     b_mul = 0;                  /* actual f/b colour multiplier */
+static uint8_t t = 0;           /* transparent, intensity blends foreground with existing content */
+static oled_rect_t clip = { 0 };        /* where drawing is allowed, always within canvas */
+#define	CLIP_DEPTH	8
+static oled_rect_t oled_clips[CLIP_DEPTH];     /* pushed clip rectangles */
+static uint8_t oled_clipn = 0;
+
+#define	IMAX	(0xFF >> ISHIFT)        /* max intensity level */
+#define	DT(n)	(((n) << ISHIFT) >> 4)  /* Bayer threshold n (0-15) scaled to one intensity level */
+static const uint8_t oled_nodither[4][4] = { {0} };
+static const uint8_t oled_bayer[4][4] = {
+   {DT(0), DT(8), DT(2), DT(10)},
+   {DT(12), DT(4), DT(14), DT(6)},
+   {DT(3), DT(11), DT(1), DT(9)},
+   {DT(15), DT(7), DT(13), DT(5)},
+};
+static const uint8_t (*d)[4] = oled_nodither;   /* dither thresholds, indexed y&3, x&3 */
 
 /* state control */
 void oled_pos(oled_pos_t newx, oled_pos_t newy, oled_align_t newa)
@@ -156,7 +355,7 @@ static uint32_t oled_colour_lookup(char c)
    case 'k':
    case 'K':
       return BLACK;
-#if CONFIG_OLED_BPP == 16
+#if CONFIG_OLED_BPP >= 16
    case 'r':
       return (RED >> 1);
    case 'R':
@@ -201,6 +400,84 @@ void oled_background(char newb)
    b_mul = oled_colour_lookup(b = newb);
 }
 
+void oled_dither(uint8_t newd)
+{                               /* Set ordered dither on/off */
+   d = (newd ? oled_bayer : oled_nodither);
+}
+
+void oled_transparent(uint8_t newt)
+{                               /* Set transparent on/off */
+   t = newt;
+}
+
+static void oled_unclip(void)
+{                               /* clip to whole canvas */
+   oled_clipn = 0;
+   clip.l = clip.t = 0;
+   clip.r = canvas->w;
+   clip.b = canvas->h;
+}
+
+void oled_select(oled_canvas_t * newc)
+{                               /* Set canvas, NULL for display */
+   canvas = (newc ? : &oled_layers[0]);
+   oled_unclip();
+}
+
+void oled_layer(uint8_t n)
+{                               /* Set display layer as canvas */
+   if (n < CONFIG_OLED_LAYERS)
+   {
+      canvas = &oled_layers[n];
+      oled_unclip();
+   }
+}
+
+static void oled_align(oled_pos_t w, oled_pos_t h, oled_pos_t * lp, oled_pos_t * tp)
+{                               /* top left of a box w/h aligned at position */
+   oled_pos_t l = x,
+       top = y;
+   if ((a & OLED_C) == OLED_C)
+      l -= (w - 1) / 2;
+   else if (a & OLED_R)
+      l -= (w - 1);
+   if ((a & OLED_M) == OLED_M)
+      top -= (h - 1) / 2;
+   else if (a & OLED_B)
+      top -= (h - 1);
+   *lp = l;
+   *tp = top;
+}
+
+uint8_t oled_clip_push(oled_pos_t w, oled_pos_t h)
+{                               /* Restrict drawing to area at position, within any existing clip, returns 0 if too deep */
+   if (oled_clipn == CLIP_DEPTH)
+      return 0;
+   oled_clips[oled_clipn++] = clip;
+   oled_pos_t l,
+    top;
+   oled_align(w, h, &l, &top);
+   if (l > clip.l)
+      clip.l = l;
+   if (top > clip.t)
+      clip.t = top;
+   if (l + w < clip.r)
+      clip.r = l + w;
+   if (top + h < clip.b)
+      clip.b = top + h;
+   if (clip.r < clip.l)
+      clip.r = clip.l;          /* empty */
+   if (clip.b < clip.t)
+      clip.b = clip.t;
+   return 1;
+}
+
+void oled_clip_pop(void)
+{                               /* Back to clip before last push */
+   if (oled_clipn)
+      clip = oled_clips[--oled_clipn];
+}
+
 /* State get */
 oled_pos_t oled_x(void)
 {
@@ -227,35 +504,265 @@ char oled_b(void)
    return b;
 }
 
+uint8_t oled_d(void)
+{
+   return d == oled_bayer;
+}
+
+uint8_t oled_t(void)
+{
+   return t;
+}
+
+void oled_clip_get(oled_pos_t * xp, oled_pos_t * yp, oled_pos_t * wp, oled_pos_t * hp)
+{
+   if (xp)
+      *xp = clip.l;
+   if (yp)
+      *yp = clip.t;
+   if (wp)
+      *wp = clip.r - clip.l;
+   if (hp)
+      *hp = clip.b - clip.t;
+}
+
 /* support */
-inline void oled_pixel(oled_pos_t x, oled_pos_t y, oled_intensity_t i)
-{                               /* set a pixel */
-   if (x < 0 || x >= CONFIG_OLED_WIDTH || y < 0 || y >= CONFIG_OLED_HEIGHT)
-      return;                   /* out of display */
+static inline oled_cell_t oled_cell(oled_pos_t x, oled_pos_t y, oled_intensity_t i)
+{                               /* intensity to cell value at x/y, the dither threshold is added before reducing to IMAX levels */
+   uint8_t l = (i + d[y & 3][x & 3]) >> ISHIFT;
+   l -= l >> (8 - ISHIFT);      /* saturate at IMAX, no branch */
 #if CONFIG_OLED_BPP <= 8
-#error	Not coded greyscale yet
+   return l;
 #else
-   uint16_t v = ntohs(f_mul * (i >> ISHIFT) + b_mul * ((0xFF ^ i) >> ISHIFT));
-   if (v != oled[(y * CONFIG_OLED_WIDTH) + x])
+   return oled_rgb(f_mul * l + b_mul * (IMAX - l));
+#endif
+}
+
+#if CONFIG_OLED_BPP == 16
+#define	SWAR565	0x07E0F81F      /* RGB565 spread as ----- GGGGGG ----- RRRRR ------ BBBBB, leaving room to multiply by 0-32 */
+static inline oled_cell_t oled_blend(oled_pos_t x, oled_pos_t y, oled_intensity_t i, oled_cell_t old)
+{                               /* foreground blended over existing cell by intensity, all three colours at once */
+   uint32_t alpha = (i + (i >> 7) + (d[y & 3][x & 3] >> (ISHIFT - 3))) >> 3;  /* 0-32 */
+   uint32_t fg = f_mul * IMAX;
+   uint32_t bg = ntohs(old);
+   fg = (fg | (fg << 16)) & SWAR565;
+   bg = (bg | (bg << 16)) & SWAR565;
+   bg = ((fg * alpha + bg * (32 - alpha)) >> 5) & SWAR565;
+   return htons(bg | (bg >> 16));
+}
+#elif CONFIG_OLED_BPP == 18
+static inline oled_cell_t oled_blend(oled_pos_t x, oled_pos_t y, oled_intensity_t i, oled_cell_t old)
+{                               /* foreground blended over existing cell by intensity, a byte per colour */
+   uint32_t alpha = (i + (i >> 7) + d[y & 3][x & 3]) >> ISHIFT;       /* 0-64 */
+   oled_cell_t fg = oled_rgb(f_mul * IMAX);
+   for (int k = 0; k < 3; k++)
+      old.c[k] = (fg.c[k] * alpha + old.c[k] * (64 - alpha)) >> 6;
+   return old;
+}
+#endif
+
+static void oled_clean(oled_canvas_t * c)
+{                               /* no damage */
+   c->dirty_l = c->w;
+   c->dirty_t = c->h;
+   c->dirty_r = c->dirty_b = -1;
+}
+
+static int oled_clip(const oled_rect_t * c, oled_pos_t * xp, oled_pos_t * yp, oled_pos_t * wp, oled_pos_t * hp, oled_pos_t * dxp, oled_pos_t * dyp)
+{                               /* clip a box to a rectangle, dx/dy set to offset of clipped box within original, returns 0 if nothing left */
+   oled_pos_t dx = 0,
+       dy = 0;
+   if (*xp < c->l)
+      dx = c->l - *xp;
+   if (*yp < c->t)
+      dy = c->t - *yp;
+   *xp += dx;
+   *yp += dy;
+   *wp -= dx;
+   *hp -= dy;
+   if (*xp + *wp > c->r)
+      *wp = c->r - *xp;
+   if (*yp + *hp > c->b)
+      *hp = c->b - *yp;
+   if (dxp)
+      *dxp = dx;
+   if (dyp)
+      *dyp = dy;
+   return *wp > 0 && *hp > 0;
+}
+
+static void oled_panel_clean(oled_panel_t * p)
+{                               /* no damage on this panel */
+   p->dirty = (oled_rect_t) {.l = VWIDTH,.t = VHEIGHT };
+}
+
+static void oled_panel_damage(oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_pos_t h)
+{                               /* add damage to each panel showing some of it, so panels do not send each other's changes */
+   for (int n = 0; n < oled_npanels; n++)
    {
-      oled[(y * CONFIG_OLED_WIDTH) + x] = v;
-      oled_changed = 1;
+      oled_panel_t *p = &oled_panels[n];
+      oled_rect_t r = {.l = oled_shown_x + p->x,.t = oled_shown_y + p->y };
+      r.r = r.l + CONFIG_OLED_WIDTH;
+      r.b = r.t + CONFIG_OLED_HEIGHT;   /* what the panel shows */
+      oled_pos_t px = x,
+          py = y,
+          pw = w,
+          ph = h;
+      if (!oled_clip(&r, &px, &py, &pw, &ph, NULL, NULL))
+         continue;
+      if (px < p->dirty.l)
+         p->dirty.l = px;
+      if (py < p->dirty.t)
+         p->dirty.t = py;
+      if (px + pw > p->dirty.r)
+         p->dirty.r = px + pw;
+      if (py + ph > p->dirty.b)
+         p->dirty.b = py + ph;
+   }
+}
+
+static inline void oled_damage(oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_pos_t h)
+{                               /* area of canvas has been drawn on, already clipped, only matters for the display */
+   if (!canvas->layer)
+      return;
+   if (x < canvas->dirty_l)
+      canvas->dirty_l = x;
+   if (y < canvas->dirty_t)
+      canvas->dirty_t = y;
+   if (x + w - 1 > canvas->dirty_r)
+      canvas->dirty_r = x + w - 1;
+   if (y + h - 1 > canvas->dirty_b)
+      canvas->dirty_b = y + h - 1;
+   if (oled_npanels > 1)
+      oled_panel_damage(x, y, w, h);
+   oled_changed = 1;
+}
+
+static void oled_kick(void)
+{                               /* something to do for the update task */
+   oled_changed = 1;
+   if (oled_task_id)
+      xTaskNotifyGive(oled_task_id);
+}
+
+static inline uint8_t oled_put(oled_pos_t x, oled_pos_t y, oled_intensity_t i)
+{                               /* set a pixel, already clipped, returns if changed, caller does damage */
+#if CONFIG_OLED_BPP <= 8
+#error	Not coded greyscale yet
+#else
+   oled_cell_t *o = canvas->cells + y * canvas->w + x;
+   oled_cell_t v = (t ? oled_blend(x, y, i, *o) : oled_cell(x, y, i));
+   if (oled_same(v, *o))
+      return 0;
+   *o = v;
+   return 1;
+#endif
+}
+
+inline void oled_pixel(oled_pos_t x, oled_pos_t y, oled_intensity_t i)
+{                               /* set a pixel */
+   if (x < clip.l || x >= clip.r || y < clip.t || y >= clip.b)
+      return;                   /* out of clip */
+   if (oled_put(x, y, i))
+      oled_damage(x, y, 1, 1);
+}
+
+#if CONFIG_OLED_BPP == 16
+typedef uint32_t __attribute__((__may_alias__)) oled_pair_t;    /* two cells */
+#endif
+
+static void oled_span(oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_intensity_t i)
+{                               /* set w pixels from x/y, already clipped, damaged if changed */
+   oled_cell_t *o = canvas->cells + y * canvas->w + x;
+   uint8_t changed = 0;
+   oled_pos_t n = 0;
+#if CONFIG_OLED_BPP == 16
+   if (!t && w >= 8)
+   {                            /* store pairs of cells, the dither pattern repeats every 4 */
+      oled_cell_t c[4];
+      for (int k = 0; k < 4; k++)
+         c[k] = oled_cell(x + k, y, i);
+      if ((uintptr_t) o & 2)
+      {                         /* align */
+         changed |= (*o != c[0]);
+         *o = c[0];
+         n = 1;
+      }
+      oled_pair_t p0 = c[n] | ((oled_pair_t) c[n + 1] << 16),
+          p1 = c[(n + 2) & 3] | ((oled_pair_t) c[(n + 3) & 3] << 16);
+      oled_pair_t *p = (oled_pair_t *) (o + n);
+      for (; n + 4 <= w; n += 4, p += 2)
+      {
+         changed |= (p[0] != p0) | (p[1] != p1);
+         p[0] = p0;
+         p[1] = p1;
+      }
+   }
+#elif CONFIG_OLED_BPP == 18
+   if (!t && w >= 8)
+   {                            /* store 4 cells (12 bytes) at a time, the dither pattern repeats every 4 */
+      oled_cell_t c[4];
+      for (int k = 0; k < 4; k++)
+         c[k] = oled_cell(x + k, y, i);
+      for (; n + 4 <= w; n += 4)
+      {
+         changed |= (memcmp(o + n, c, sizeof(c)) != 0);
+         memcpy(o + n, c, sizeof(c));
+      }
    }
 #endif
+   for (; n < w; n++)
+      changed |= oled_put(x + n, y, i);
+   if (changed)
+      oled_damage(x, y, w, 1);
+}
+
+static void oled_hline(oled_pos_t x0, oled_pos_t x1, oled_pos_t y, oled_intensity_t i)
+{                               /* horizontal line, inclusive, clipped */
+   if (y < clip.t || y >= clip.b)
+      return;
+   if (x0 > x1)
+   {
+      oled_pos_t s = x0;
+      x0 = x1;
+      x1 = s;
+   }
+   if (x0 < clip.l)
+      x0 = clip.l;
+   if (x1 >= clip.r)
+      x1 = clip.r - 1;
+   if (x1 >= x0)
+      oled_span(x0, y, x1 - x0 + 1, i);
+}
+
+static void oled_vline(oled_pos_t x, oled_pos_t y0, oled_pos_t y1, oled_intensity_t i)
+{                               /* vertical line, inclusive, clipped */
+   if (x < clip.l || x >= clip.r)
+      return;
+   if (y0 > y1)
+   {
+      oled_pos_t s = y0;
+      y0 = y1;
+      y1 = s;
+   }
+   if (y0 < clip.t)
+      y0 = clip.t;
+   if (y1 >= clip.b)
+      y1 = clip.b - 1;
+   if (y1 < y0)
+      return;
+   uint8_t changed = 0;
+   for (oled_pos_t y = y0; y <= y1; y++)
+      changed |= oled_put(x, y, i);
+   if (changed)
+      oled_damage(x, y0, 1, y1 - y0 + 1);
 }
 
 static void oled_draw(oled_pos_t w, oled_pos_t h, oled_pos_t wm, oled_pos_t hm, oled_pos_t * xp, oled_pos_t * yp)
 {                               /* move x/y based on drawing a box w/h, set x/y as top left of said box */
-   oled_pos_t l = x,
-       t = y;
-   if ((a & OLED_C) == OLED_C)
-      l -= (w - 1) / 2;
-   else if (a & OLED_R)
-      l -= (w - 1);
-   if ((a & OLED_M) == OLED_M)
-      t -= (h - 1) / 2;
-   else if (a & OLED_B)
-      t -= (h - 1);
+   oled_pos_t l,
+    t;
+   oled_align(w, h, &l, &t);
    if (a & OLED_H)
    {
       if (a & OLED_L)
@@ -280,28 +787,282 @@ static void oled_block16(oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_pos_t h,
 {                               /* Draw a block from 16 bit greyscale data, l is data width for each row */
    if (!l)
       l = (w + 1) / 2;          /* default is pixels width */
+   oled_pos_t dx,
+    dy;
+   if (!oled_clip(&clip, &x, &y, &w, &h, &dx, &dy))
+      return;
+   data += dy * l;
+   uint8_t changed = 0;
+#if CONFIG_OLED_BPP >= 16
+   if (!t && d == oled_nodither)
+   {                            /* glyphs, only 16 possible cells, so work them out once */
+      oled_cell_t c[16];
+      for (int v = 0; v < 16; v++)
+         c[v] = oled_cell(0, 0, v | (v << 4));
+      for (oled_pos_t row = 0; row < h; row++)
+      {
+         oled_cell_t *o = canvas->cells + (y + row) * canvas->w + x;
+         for (oled_pos_t col = 0; col < w; col++)
+         {
+            uint8_t v = data[(dx + col) / 2];
+            oled_cell_t n = c[((dx + col) & 1) ? (v & 0xF) : (v >> 4)];
+            if (oled_same(n, o[col]))
+               continue;
+            o[col] = n;
+            changed = 1;
+         }
+         data += l;
+      }
+      if (changed)
+         oled_damage(x, y, w, h);
+      return;
+   }
+#endif
    for (oled_pos_t row = 0; row < h; row++)
    {
       for (oled_pos_t col = 0; col < w; col++)
       {
-         uint8_t v = data[col / 2];
-         oled_pixel(x + col, y + row, (v & 0xF0) | (v >> 4));
-         col++;
-         if (col < w)
-            oled_pixel(x + col, y + row, (v & 0xF) | (v << 4));
+         uint8_t v = data[(dx + col) / 2];
+         changed |= oled_put(x + col, y + row, ((dx + col) & 1) ? (v & 0xF) | (v << 4) : (v & 0xF0) | (v >> 4));
       }
       data += l;
    }
+   if (changed)
+      oled_damage(x, y, w, h);
+}
+
+#ifdef	CONFIG_OLED_SSD1331
+static uint8_t oled_accel_can(uint8_t n)
+{                               /* n more controller operations can be queued for what we are drawing on, only unrotated as they use frame buffer coordinates as display RAM addresses */
+   return CONFIG_OLED_LAYERS == 1 && canvas == oled_layers && !t && !oled_rotation && !oled_rotated && oled_accels + n <= ACCEL_MAX;
+}
+
+static uint8_t oled_accel_solid(oled_pos_t x, oled_pos_t y, oled_intensity_t i, oled_cell_t * cp)
+{                               /* intensity is one colour, i.e. not dithered to a pattern */
+   oled_cell_t c = oled_cell(x, y, i);
+   for (int k = 1; k < 16; k++)
+      if (!oled_same(oled_cell(x + (k & 3), y + (k >> 2), i), c))
+         return 0;
+   *cp = c;
+   return 1;
+}
+
+static void oled_accel_draw(uint8_t cmd, oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_pos_t h, oled_cell_t c, oled_intensity_t i)
+{                               /* solid area, already clipped, in the frame buffer without damage, and queued for the controller if anything changed */
+   oled_pos_t l = canvas->dirty_l,
+       top = canvas->dirty_t,
+       r = canvas->dirty_r,
+       bot = canvas->dirty_b;
+   oled_rect_t was[CONFIG_OLED_PANELS]; /* panel damage too */
+   for (int n = 0; n < oled_npanels; n++)
+      was[n] = oled_panels[n].dirty;
+   oled_clean(canvas);
+   for (oled_pos_t row = 0; row < h; row++)
+      oled_span(x, y + row, w, i);
+   uint8_t changed = (canvas->dirty_r >= canvas->dirty_l);
+   canvas->dirty_l = l;
+   canvas->dirty_t = top;
+   canvas->dirty_r = r;
+   canvas->dirty_b = bot;
+   for (int n = 0; n < oled_npanels; n++)
+      oled_panels[n].dirty = was[n];
+   if (!changed)
+      return;
+   oled_accel[oled_accels++] = (oled_accel_t) {.cmd = cmd,.x = x,.y = y,.w = w,.h = h,.c = c };
+   oled_changed = 1;
+}
+
+static uint8_t oled_accel_copy(oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_pos_t h, oled_pos_t dx, oled_pos_t dy)
+{                               /* queue a move of an area by the controller, the display must match the frame buffer, and both be on one panel without the display RAM wrapping */
+   /* The controller copies top to bottom, left to right, so a move down or right over itself is done as bands from the far end, each moved clear of itself */
+   oled_pos_t band = 0,
+       bands = 1;
+   if (dy > 0 && dy < h && (dx < 0 ? -dx : dx) < w)
+      bands = (h + (band = dy) - 1) / dy;       /* rows, from the bottom */
+   else if (!dy && dx > 0 && dx < w)
+      bands = (w + (band = dx) - 1) / dx;       /* columns, from the right */
+   if (!oled_accel_can(bands) || oled_gram_differs || oled_rotation != oled_rotated || oled_view_x != oled_shown_x || oled_view_y != oled_shown_y || canvas->dirty_r >= canvas->dirty_l)
+      return 0;
+   oled_pos_t l = (dx < 0 ? x + dx : x),
+       top = (dy < 0 ? y + dy : y),
+       r = (dx > 0 ? x + dx : x) + w,
+       bot = (dy > 0 ? y + dy : y) + h; /* source and destination */
+   for (int n = 0; n < oled_npanels; n++)
+   {
+      oled_panel_t *p = &oled_panels[n];
+      oled_pos_t pl = oled_shown_x + p->x,
+          pt = oled_shown_y + p->y;
+      if (!p->ready || l < pl || top < pt || r > pl + CONFIG_OLED_WIDTH || bot > pt + CONFIG_OLED_HEIGHT)
+         continue;
+      if ((oled_gram_top + top - pt) % GRAM_ROWS + bot - top > GRAM_ROWS)
+         return 0;
+      if (!band)
+         oled_accel[oled_accels++] = (oled_accel_t) {.cmd = 0x23,.x = x,.y = y,.w = w,.h = h,.dx = dx,.dy = dy };
+      else if (dy)
+         for (oled_pos_t e = y + h; e > y; e -= band)
+            oled_accel[oled_accels++] = (oled_accel_t) {.cmd = 0x23,.x = x,.y = (e - band > y ? e - band : y),.w = w,.h = (e - band > y ? band : e - y),.dx = dx,.dy = dy };
+      else
+         for (oled_pos_t e = x + w; e > x; e -= band)
+            oled_accel[oled_accels++] = (oled_accel_t) {.cmd = 0x23,.x = (e - band > x ? e - band : x),.y = y,.w = (e - band > x ? band : e - x),.h = h,.dx = dx,.dy = dy };
+      oled_changed = 1;
+      return 1;
+   }
+   return 0;
+}
+
+static void oled_accel_drop(void)
+{                               /* queued controller drawing becomes damage, to be sent as pixels */
+   oled_canvas_t *was = canvas;
+   canvas = oled_layers;
+   for (int q = 0; q < oled_accels; q++)
+   {
+      oled_accel_t *a = &oled_accel[q];
+      oled_damage(a->x, a->y, a->w, a->h);
+      if (a->cmd == 0x23)
+         oled_damage(a->x + a->dx, a->y + a->dy, a->w, a->h);
+   }
+   canvas = was;
+   oled_accels = 0;
+}
+
+static uint8_t oled_accel_box(oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_pos_t h, oled_intensity_t i)
+{                               /* box outline as four controller lines, if all within clip */
+   oled_cell_t c;
+   if (w < 3 || h < 3 || x < clip.l || y < clip.t || x + w > clip.r || y + h > clip.b || !oled_accel_can(4) || !oled_accel_solid(x, y, i, &c))
+      return 0;
+   oled_accel_draw(0x21, x, y, w, 1, c, i);
+   oled_accel_draw(0x21, x, y + h - 1, w, 1, c, i);
+   oled_accel_draw(0x21, x, y + 1, 1, h - 2, c, i);
+   oled_accel_draw(0x21, x + w - 1, y + 1, 1, h - 2, c, i);
+   return 1;
+}
+#endif
+
+static void oled_area(oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_pos_t h, oled_intensity_t i)
+{                               /* filled rectangle, already clipped, by the controller if it can */
+#ifdef	CONFIG_OLED_SSD1331
+   oled_cell_t c;
+   if (oled_accel_can(1) && oled_accel_solid(x, y, i, &c))
+   {
+      oled_accel_draw(0x22, x, y, w, h, c, i);
+      return;
+   }
+#endif
+   for (oled_pos_t row = 0; row < h; row++)
+      oled_span(x, y + row, w, i);
 }
 
 /* drawing */
+void oled_pixels(oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_pos_t h, const oled_intensity_t * data, int stride)
+{                               /* block of intensities, clipped once, damaged once */
+   if (!canvas->cells || !data)
+      return;
+   oled_pos_t dx,
+    dy;
+   if (!oled_clip(&clip, &x, &y, &w, &h, &dx, &dy))
+      return;
+   data += dy * stride + dx;
+   uint8_t changed = 0;
+   for (oled_pos_t row = 0; row < h; row++)
+   {
+      for (oled_pos_t col = 0; col < w; col++)
+         changed |= oled_put(x + col, y + row, data[col]);
+      data += stride;
+   }
+   if (changed)
+      oled_damage(x, y, w, h);
+}
+
+void oled_pixels_row(oled_pos_t x, oled_pos_t y, oled_pos_t n, const oled_intensity_t * data)
+{                               /* n pixels right from x/y */
+   oled_pixels(x, y, n, 1, data, n);
+}
+
+void oled_pixels_column(oled_pos_t x, oled_pos_t y, oled_pos_t n, const oled_intensity_t * data)
+{                               /* n pixels down from x/y */
+   oled_pixels(x, y, 1, n, data, 1);
+}
+
 void oled_clear(oled_intensity_t i)
 {
-   if (!oled)
+   if (!canvas->cells || clip.r <= clip.l || clip.b <= clip.t)
       return;
-   for (oled_pos_t y = 0; y < CONFIG_OLED_HEIGHT; y++)
-      for (oled_pos_t x = 0; x < CONFIG_OLED_WIDTH; x++)
-         oled_pixel(x, y, i);
+   oled_area(clip.l, clip.t, clip.r - clip.l, clip.b - clip.t, i);
+}
+
+void oled_rotate(uint16_t deg)
+{                               /* Set rotation, 90/270 only on a square display, only one panel */
+   uint8_t r = (deg / 90) & 3;
+   if ((r & 1) && CONFIG_OLED_WIDTH != CONFIG_OLED_HEIGHT)
+      return;
+   if (r && oled_npanels > 1)
+      return;
+   oled_rotation = r;
+   oled_kick();
+}
+
+void oled_fade(oled_intensity_t level, uint32_t ms)
+{                               /* Fade to level (255 normal, 0 dark) over ms */
+   if (ms > EFFECT_MS_MAX)
+      ms = EFFECT_MS_MAX;
+   oled_fade_req = level;
+   oled_fade_us_req = (ms ? ms * 1000 : 1);
+   __atomic_fetch_or(&oled_regs, REG_FADE, __ATOMIC_RELEASE);
+   oled_kick();
+}
+
+void oled_set_mode(uint8_t mode)
+{                               /* Set display mode, stops blinking */
+   oled_mode_req = mode;
+   __atomic_fetch_and(&oled_regs, ~REG_BLINK, __ATOMIC_RELAXED);       /* an earlier blink not yet started is stopped too */
+   __atomic_fetch_or(&oled_regs, REG_MODE, __ATOMIC_RELEASE);
+   oled_kick();
+}
+
+void oled_blink(uint8_t mode, uint32_t ms, uint8_t count)
+{                               /* Alternate display mode with mode every ms, count times, 0 for until stopped */
+   if (ms > EFFECT_MS_MAX)
+      ms = EFFECT_MS_MAX;
+   oled_blink_mode_req = mode;
+   oled_blink_us_req = ms * 1000;
+   oled_blink_left_req = (!ms ? 0 : count ? count * 2 : -1);
+   __atomic_fetch_or(&oled_regs, REG_BLINK, __ATOMIC_RELEASE);
+   oled_kick();
+}
+
+void oled_schedule(uint16_t fps, uint16_t latency, uint8_t duty)
+{                               /* Set how often changes are sent */
+   oled_frame_us = 1000000 / (fps ? : CONFIG_OLED_FPS);
+   oled_latency_us = latency * 1000;
+   oled_duty = (duty && duty <= 100 ? duty : 100);
+   oled_kick();
+}
+
+void oled_stats(oled_stats_t * s, uint8_t reset)
+{                               /* Get stats */
+   if (s)
+      *s = oled_stat;
+   if (reset)
+      memset(&oled_stat, 0, sizeof(oled_stat));
+}
+
+void oled_bus(uint16_t chunk, uint8_t priority)
+{                               /* Set how the SPI bus is shared */
+   oled_chunk = (chunk && chunk < BUS_MAX ? chunk : BUS_MAX);
+   if (priority && oled_task_id)
+      vTaskPrioritySet(oled_task_id, priority);
+}
+
+void oled_sleep(void)
+{                               /* Display off, low power */
+   oled_sleep_req = 1;
+   oled_kick();
+}
+
+void oled_wake(void)
+{                               /* Display on, sends anything drawn while asleep */
+   oled_sleep_req = 0;
+   oled_kick();
 }
 
 void oled_set_contrast(oled_intensity_t contrast)
@@ -309,8 +1070,29 @@ void oled_set_contrast(oled_intensity_t contrast)
    if (!oled)
       return;
    oled_contrast = contrast;
-   oled_update = 1;
-   oled_changed = 1;
+   __atomic_fetch_or(&oled_regs, REG_CONTRAST, __ATOMIC_RELEASE);
+   oled_kick();
+}
+
+void oled_set_channel_contrast(uint8_t a, uint8_t b, uint8_t c)
+{
+   if (!oled)
+      return;
+   oled_channel[0] = a;
+   oled_channel[1] = b;
+   oled_channel[2] = c;
+   __atomic_fetch_or(&oled_regs, REG_CHANNEL, __ATOMIC_RELEASE);
+   oled_kick();
+}
+
+void oled_set_precharge(uint8_t voltage, uint8_t period)
+{
+   if (!oled)
+      return;
+   oled_precharge_v = voltage & 0x1F;
+   oled_precharge_t = period & 0x0F;
+   __atomic_fetch_or(&oled_regs, REG_PRECHARGE, __ATOMIC_RELEASE);
+   oled_kick();
 }
 
 void oled_box(oled_pos_t w, oled_pos_t h, oled_intensity_t i)
@@ -318,15 +1100,20 @@ void oled_box(oled_pos_t w, oled_pos_t h, oled_intensity_t i)
    oled_pos_t x,
     y;
    oled_draw(w, h, 0, 0, &x, &y);
-   for (oled_pos_t n = 0; n < w; n++)
-   {
-      oled_pixel(x + n, y, i);
-      oled_pixel(x + n, y + h - 1, i);
-   }
-   for (oled_pos_t n = 1; n < h - 1; n++)
+   if (!canvas->cells || w <= 0 || h <= 0)
+      return;
+#ifdef	CONFIG_OLED_SSD1331
+   if (oled_accel_box(x, y, w, h, i))
+      return;
+#endif
+   oled_hline(x, x + w - 1, y, i);
+   if (h > 1)
+      oled_hline(x, x + w - 1, y + h - 1, i);
+   if (h > 2)
    {
-      oled_pixel(x, y + n, i);
-      oled_pixel(x + w - 1, y + n, i);
+      oled_vline(x, y + 1, y + h - 2, i);
+      if (w > 1)
+         oled_vline(x + w - 1, y + 1, y + h - 2, i);
    }
 }
 
@@ -335,31 +1122,1005 @@ void oled_fill(oled_pos_t w, oled_pos_t h, oled_intensity_t i)
    oled_pos_t x,
     y;
    oled_draw(w, h, 0, 0, &x, &y);
-   for (oled_pos_t row = 0; row < h; row++)
-      for (oled_pos_t col = 0; col < w; col++)
-         oled_pixel(x + col, y + row, i);
+   if (!canvas->cells || !oled_clip(&clip, &x, &y, &w, &h, NULL, NULL))
+      return;
+   oled_area(x, y, w, h, i);
 }
 
-void oled_icon16(oled_pos_t w, oled_pos_t h, const void *data)
-{                               /* Icon, 16 bit packed */
-   if (!data)
-      oled_fill(w, h, 0);       /* No icon */
-   else
+void oled_line(oled_pos_t x0, oled_pos_t y0, oled_pos_t x1, oled_pos_t y1, oled_intensity_t i)
+{                               /* draw a line, inclusive */
+   if (!canvas->cells)
+      return;
+   if (y0 == y1)
    {
-      oled_pos_t x,
-       y;
-      oled_draw(w, h, 0, 0, &x, &y);
-      oled_block16(x, y, w, h, data, 0);
+      oled_hline(x0, x1, y0, i);
+      return;
+   }
+   if (x0 == x1)
+   {
+      oled_vline(x0, y0, y1, i);
+      return;
+   }
+   int dx = (x1 > x0 ? x1 - x0 : x0 - x1),
+       sx = (x1 > x0 ? 1 : -1),
+       dy = (y1 > y0 ? y0 - y1 : y1 - y0),
+       sy = (y1 > y0 ? 1 : -1),
+       err = dx + dy;
+   oled_pos_t l = (x0 < x1 ? x0 : x1),
+       top = (y0 < y1 ? y0 : y1);
+   uint8_t inside = (l >= clip.l && top >= clip.t && l + dx < clip.r && top - dy < clip.b),
+       changed = 0;
+   while (1)
+   {
+      if (inside)
+         changed |= oled_put(x0, y0, i);
+      else
+         oled_pixel(x0, y0, i);
+      if (x0 == x1 && y0 == y1)
+         break;
+      int e2 = 2 * err;
+      if (e2 >= dy)
+      {
+         err += dy;
+         x0 += sx;
+      }
+      if (e2 <= dx)
+      {
+         err += dx;
+         y0 += sy;
+      }
    }
+   if (changed)
+      oled_damage(l, top, dx + 1, 1 - dy);
 }
 
-void oled_text(int8_t size, const char *fmt, ...)
-{                               /* Size negative for descenders */
-   if (!oled)
+static oled_pos_t oled_extent(oled_pos_t r, oled_pos_t dy, oled_pos_t dx)
+{                               /* widen dx to half width of circle radius r at dy from centre, working in from dy=r */
+   while ((dx + 1) * (dx + 1) + dy * dy <= r * r + r)
+      dx++;
+   return dx;
+}
+
+void oled_circle(oled_pos_t cx, oled_pos_t cy, oled_pos_t r, oled_intensity_t i)
+{                               /* draw a circle */
+   if (!canvas->cells || r < 0)
       return;
-   va_list ap;
-   char temp[CONFIG_OLED_WIDTH / 4 + 2];
-   va_start(ap, fmt);
+   uint8_t inside = (cx - r >= clip.l && cy - r >= clip.t && cx + r < clip.r && cy + r < clip.b),
+       changed = 0;
+   void plot(oled_pos_t x, oled_pos_t y) {
+      if (inside)
+         changed |= oled_put(x, y, i);
+      else
+         oled_pixel(x, y, i);
+   }
+   void plot4(oled_pos_t dx, oled_pos_t dy) {   /* each point once */
+      plot(cx + dx, cy + dy);
+      if (dx)
+         plot(cx - dx, cy + dy);
+      if (dy)
+         plot(cx + dx, cy - dy);
+      if (dx && dy)
+         plot(cx - dx, cy - dy);
+   }
+   oled_pos_t dx = r,
+       dy = 0;
+   int err = 1 - r;
+   while (dx >= dy)
+   {
+      plot4(dx, dy);
+      if (dx != dy)
+         plot4(dy, dx);
+      dy++;
+      if (err < 0)
+         err += 2 * dy + 1;
+      else
+      {
+         dx--;
+         err += 2 * (dy - dx) + 1;
+      }
+   }
+   if (changed)
+      oled_damage(cx - r, cy - r, r * 2 + 1, r * 2 + 1);
+}
+
+void oled_fill_circle(oled_pos_t cx, oled_pos_t cy, oled_pos_t r, oled_intensity_t i)
+{                               /* draw a filled circle, by row */
+   if (!canvas->cells || r < 0)
+      return;
+   oled_pos_t dx = 0;
+   for (oled_pos_t dy = r; dy >= 0; dy--)
+   {
+      dx = oled_extent(r, dy, dx);
+      oled_hline(cx - dx, cx + dx, cy - dy, i);
+      if (dy)
+         oled_hline(cx - dx, cx + dx, cy + dy, i);
+   }
+}
+
+static oled_pos_t oled_round_start(oled_pos_t w, oled_pos_t h, oled_pos_t r, oled_pos_t * xp, oled_pos_t * yp)
+{                               /* position rounded box, return usable radius */
+   oled_draw(w, h, 0, 0, xp, yp);
+   if (!canvas->cells || w <= 0 || h <= 0)
+      return -1;
+   if (r > (w - 1) / 2)
+      r = (w - 1) / 2;
+   if (r > (h - 1) / 2)
+      r = (h - 1) / 2;
+   return r < 0 ? 0 : r;
+}
+
+void oled_round_box(oled_pos_t w, oled_pos_t h, oled_pos_t r, oled_intensity_t i)
+{                               /* draw a box with rounded corners, not filled */
+   oled_pos_t x,
+    y;
+   if ((r = oled_round_start(w, h, r, &x, &y)) < 0)
+      return;
+   oled_pos_t l = x + r,
+       rt = x + w - 1 - r,
+       top = y + r,
+       bot = y + h - 1 - r;     /* corner centres */
+   oled_hline(l, rt, y, i);
+   oled_hline(l, rt, y + h - 1, i);
+   oled_vline(x, top, bot, i);
+   oled_vline(x + w - 1, top, bot, i);
+   if (!r)
+      return;
+   uint8_t inside = (x >= clip.l && y >= clip.t && x + w <= clip.r && y + h <= clip.b),
+       changed = 0;
+   void plot(oled_pos_t x, oled_pos_t y) {
+      if (inside)
+         changed |= oled_put(x, y, i);
+      else
+         oled_pixel(x, y, i);
+   }
+   void corners(oled_pos_t dx, oled_pos_t dy) { /* edges have done points on the axes */
+      if (!dx || !dy)
+         return;
+      plot(l - dx, top - dy);
+      plot(rt + dx, top - dy);
+      plot(l - dx, bot + dy);
+      plot(rt + dx, bot + dy);
+   }
+   oled_pos_t dx = r,
+       dy = 0;
+   int err = 1 - r;
+   while (dx >= dy)
+   {
+      corners(dx, dy);
+      if (dx != dy)
+         corners(dy, dx);
+      dy++;
+      if (err < 0)
+         err += 2 * dy + 1;
+      else
+      {
+         dx--;
+         err += 2 * (dy - dx) + 1;
+      }
+   }
+   if (changed)
+      oled_damage(x, y, w, h);
+}
+
+void oled_round_fill(oled_pos_t w, oled_pos_t h, oled_pos_t r, oled_intensity_t i)
+{                               /* draw a filled box with rounded corners, by row */
+   oled_pos_t x,
+    y;
+   if ((r = oled_round_start(w, h, r, &x, &y)) < 0)
+      return;
+   oled_pos_t dx = 0;
+   for (oled_pos_t dy = r; dy > 0; dy--)
+   {
+      dx = oled_extent(r, dy, dx);
+      oled_hline(x + r - dx, x + w - 1 - r + dx, y + r - dy, i);
+      oled_hline(x + r - dx, x + w - 1 - r + dx, y + h - 1 - r + dy, i);
+   }
+   for (oled_pos_t row = y + r; row <= y + h - 1 - r; row++)
+      oled_hline(x, x + w - 1, row, i);
+}
+
+static const uint16_t oled_sin90[91] = {        /* sin 0-90 degrees, 1<<14 is 1 */
+   0, 286, 572, 857, 1143, 1428, 1713, 1997, 2280, 2563,
+   2845, 3126, 3406, 3686, 3964, 4240, 4516, 4790, 5063, 5334,
+   5604, 5872, 6138, 6402, 6664, 6924, 7182, 7438, 7692, 7943,
+   8192, 8438, 8682, 8923, 9162, 9397, 9630, 9860, 10087, 10311,
+   10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+   12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+   14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+   15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+   16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+   16384,
+};
+
+static int32_t oled_sin(int deg)
+{                               /* sin, 1<<14 is 1 */
+   deg %= 360;
+   if (deg < 0)
+      deg += 360;
+   if (deg <= 90)
+      return oled_sin90[deg];
+   if (deg <= 180)
+      return oled_sin90[180 - deg];
+   if (deg <= 270)
+      return -oled_sin90[deg - 180];
+   return -oled_sin90[360 - deg];
+}
+
+void oled_arc(oled_pos_t cx, oled_pos_t cy, oled_pos_t r, int16_t start, int16_t end, oled_intensity_t i)
+{                               /* draw an arc, clockwise from start to end, degrees clockwise from up */
+   if (end - start >= 360)
+   {
+      oled_circle(cx, cy, r, i);
+      return;
+   }
+   if (!canvas->cells || r < 0)
+      return;
+   int sweep = (end - start) % 360;
+   if (sweep < 0)
+      sweep += 360;
+   /* start and end directions, y is down */
+   int32_t sx = oled_sin(start),
+       sy = -oled_sin(start + 90),
+       ex = oled_sin(end),
+       ey = -oled_sin(end + 90);
+   uint8_t inside = (cx - r >= clip.l && cy - r >= clip.t && cx + r < clip.r && cy + r < clip.b),
+       changed = 0;
+   void plot(oled_pos_t dx, oled_pos_t dy) {    /* plot if clockwise of start and anticlockwise of end */
+      int32_t s = sx * dy - sy * dx,
+          e = dx * ey - dy * ex;
+      if (sweep <= 180 ? s < 0 || e < 0 : s < 0 && e < 0)
+         return;
+      if (inside)
+         changed |= oled_put(cx + dx, cy + dy, i);
+      else
+         oled_pixel(cx + dx, cy + dy, i);
+   }
+   void plot4(oled_pos_t dx, oled_pos_t dy) {   /* each point once */
+      plot(dx, dy);
+      if (dx)
+         plot(-dx, dy);
+      if (dy)
+         plot(dx, -dy);
+      if (dx && dy)
+         plot(-dx, -dy);
+   }
+   oled_pos_t dx = r,
+       dy = 0;
+   int err = 1 - r;
+   while (dx >= dy)
+   {
+      plot4(dx, dy);
+      if (dx != dy)
+         plot4(dy, dx);
+      dy++;
+      if (err < 0)
+         err += 2 * dy + 1;
+      else
+      {
+         dx--;
+         err += 2 * (dy - dx) + 1;
+      }
+   }
+   if (changed)
+      oled_damage(cx - r, cy - r, r * 2 + 1, r * 2 + 1);
+}
+
+/* polygons */
+static struct
+{                               /* edge table, pixel centres are sampled, so a row is in an edge if y0 <= row < y1 */
+   oled_pos_t y0,
+    y1;                         /* rows covered */
+   int32_t x,                   /* x at centre of current row, 16.16 */
+    dx;                         /* x change per row, 16.16 */
+   int8_t dir;                  /* +1 down, -1 up, for non zero rule */
+} oled_edges[OLED_POLY_MAX];
+
+void oled_polygon(uint8_t n, const oled_pos_t * xy, uint8_t rule, oled_intensity_t i, oled_pos_t * box)
+{                               /* draw a filled polygon, by row, box (if not NULL) set to x, y, w, h, of area drawn */
+   if (box)
+      box[0] = box[1] = box[2] = box[3] = 0;
+   if (!canvas->cells || n < 3 || n > OLED_POLY_MAX || !xy)
+      return;
+   int edges = 0;
+   oled_pos_t top = clip.b,
+       bottom = -1,
+       l = clip.r,
+       r = -1;
+   for (int p = 0; p < n; p++)
+   {
+      oled_pos_t x0 = xy[p * 2],
+          y0 = xy[p * 2 + 1],
+          x1 = xy[((p + 1) % n) * 2],
+          y1 = xy[((p + 1) % n) * 2 + 1];
+      if (x0 < l)
+         l = x0;
+      if (x0 > r)
+         r = x0;
+      if (y0 == y1)
+         continue;              /* horizontal edges are not needed */
+      int8_t dir = 1;
+      if (y0 > y1)
+      {
+         oled_pos_t s = x0;
+         x0 = x1;
+         x1 = s;
+         s = y0;
+         y0 = y1;
+         y1 = s;
+         dir = -1;
+      }
+      oled_pos_t start = (y0 < clip.t ? clip.t : y0),
+          end = (y1 > clip.b ? clip.b : y1);    /* clipped rows, end exclusive */
+      if (start >= end)
+         continue;
+      int32_t dx = (int64_t) (x1 - x0) * 65536 / (y1 - y0);
+      oled_edges[edges].y0 = start;
+      oled_edges[edges].y1 = end;
+      oled_edges[edges].x = x0 * 65536 + (int64_t) dx * ((start - y0) * 2 + 1) / 2;
+      oled_edges[edges].dx = dx;
+      oled_edges[edges].dir = dir;
+      edges++;
+      if (start < top)
+         top = start;
+      if (end > bottom)
+         bottom = end;
+   }
+   struct
+   {
+      int32_t x;
+      int8_t dir;
+   } cross[OLED_POLY_MAX];
+   for (oled_pos_t y = top; y < bottom; y++)
+   {
+      int c = 0;
+      for (int e = 0; e < edges; e++)
+         if (y >= oled_edges[e].y0 && y < oled_edges[e].y1)
+         {                      /* insert in x order */
+            int p = c++;
+            while (p && cross[p - 1].x > oled_edges[e].x)
+            {
+               cross[p] = cross[p - 1];
+               p--;
+            }
+            cross[p].x = oled_edges[e].x;
+            cross[p].dir = oled_edges[e].dir;
+            oled_edges[e].x += oled_edges[e].dx;
+         }
+      int wind = 0;
+      for (int p = 0; p + 1 < c; p++)
+      {
+         wind += (rule == OLED_NONZERO ? cross[p].dir : 1);
+         if (rule == OLED_NONZERO ? !wind : !(wind & 1))
+            continue;
+         /* pixels whose centre is from this crossing to the next */
+         oled_pos_t x0 = (cross[p].x + 32767) >> 16,
+             x1 = ((cross[p + 1].x + 32767) >> 16) - 1;
+         if (x1 >= x0)
+            oled_hline(x0, x1, y, i);
+      }
+   }
+   if (box && bottom > top)
+   {                            /* drawn area, clipped */
+      if (l < clip.l)
+         l = clip.l;
+      if (r > clip.r)
+         r = clip.r;
+      if (r > l)
+      {
+         box[0] = l;
+         box[1] = top;
+         box[2] = r - l;
+         box[3] = bottom - top;
+      }
+   }
+}
+
+/* antialiased, positions in 1/OLED_SUB pixels, coverage blends foreground over what is there */
+static inline uint8_t oled_cover(oled_pos_t x, oled_pos_t y, uint8_t c, oled_intensity_t i)
+{                               /* blend by coverage c, already clipped, returns if changed */
+   oled_cell_t *o = canvas->cells + y * canvas->w + x;
+   oled_cell_t v = oled_blend(x, y, (c * (i + 1)) >> 8, *o);
+   if (oled_same(v, *o))
+      return 0;
+   *o = v;
+   return 1;
+}
+
+void oled_aa_line(oled_pos_t x0, oled_pos_t y0, oled_pos_t x1, oled_pos_t y1, oled_intensity_t i)
+{                               /* draw an antialiased line (Wu), two pixels across the line per step */
+   if (!canvas->cells)
+      return;
+   uint8_t steep = ((y1 > y0 ? y1 - y0 : y0 - y1) > (x1 > x0 ? x1 - x0 : x0 - x1));
+   if (steep)
+   {                            /* work along y */
+      oled_pos_t s = x0;
+      x0 = y0;
+      y0 = s;
+      s = x1;
+      x1 = y1;
+      y1 = s;
+   }
+   if (x0 > x1)
+   {
+      oled_pos_t s = x0;
+      x0 = x1;
+      x1 = s;
+      s = y0;
+      y0 = y1;
+      y1 = s;
+   }
+   int32_t grad = (x1 == x0 ? 0 : (int64_t) (y1 - y0) * 65536 / (x1 - x0));      /* 16.16 */
+   oled_pos_t p0 = (x0 + OLED_SUB / 2) >> OLED_SUB_BITS,
+       p1 = (x1 + OLED_SUB / 2) >> OLED_SUB_BITS;
+   int32_t yy = (int32_t) y0 * (1 << (16 - OLED_SUB_BITS)) + (((int64_t) (p0 * OLED_SUB - x0) * grad) >> OLED_SUB_BITS);    /* 16.16 pixels */
+   int32_t ye = yy + (p1 - p0) * grad; /* at p1, so rows plotted are from the lower of yy/ye to one below the higher */
+   oled_pos_t g0 = p0 * OLED_SUB + OLED_SUB / 2 - x0,
+       g1 = x1 + OLED_SUB / 2 - p1 * OLED_SUB; /* coverage of end pixels along the line, in 1/OLED_SUB */
+   if (p0 == p1)
+      g0 = g1 = x1 - x0;
+   oled_pos_t l = p0,
+       r = p1,
+       top = (yy < ye ? yy : ye) >> 16,
+       bot = ((yy < ye ? ye : yy) >> 16) + 1;
+   if (steep)
+   {
+      oled_pos_t s = l;
+      l = top;
+      top = s;
+      s = r;
+      r = bot;
+      bot = s;
+   }
+   uint8_t inside = (l >= clip.l && top >= clip.t && r < clip.r && bot < clip.b),
+       changed = 0;
+   void plot(oled_pos_t x, oled_pos_t y, uint8_t c) {
+      if (steep)
+      {
+         oled_pos_t s = x;
+         x = y;
+         y = s;
+      }
+      if (inside)
+         changed |= oled_cover(x, y, c, i);
+      else if (x >= clip.l && x < clip.r && y >= clip.t && y < clip.b && oled_cover(x, y, c, i))
+         oled_damage(x, y, 1, 1);
+   }
+   for (oled_pos_t p = p0; p <= p1; p++, yy += grad)
+   {
+      uint8_t frac = (yy >> 8);
+      uint16_t g = (p == p0 ? g0 : p == p1 ? g1 : OLED_SUB);
+      uint8_t c0 = (255 - frac) * g >> OLED_SUB_BITS,
+          c1 = frac * g >> OLED_SUB_BITS;
+      if (c0)
+         plot(p, yy >> 16, c0);
+      if (c1)
+         plot(p, (yy >> 16) + 1, c1);
+   }
+   if (changed)
+      oled_damage(l, top, r - l + 1, bot - top + 1);
+}
+
+static uint32_t oled_isqrt(uint64_t v)
+{                               /* integer square root */
+   uint64_t r = 0,
+       bit = (uint64_t) 1 << 62;
+   while (bit > v)
+      bit >>= 2;
+   while (bit)
+   {
+      if (v >= r + bit)
+      {
+         v -= r + bit;
+         r = (r >> 1) + bit;
+      } else
+         r >>= 1;
+      bit >>= 2;
+   }
+   return r;
+}
+
+void oled_aa_circle(oled_pos_t cx, oled_pos_t cy, oled_pos_t r, oled_intensity_t i)
+{                               /* draw an antialiased circle, by column near top/bottom and by row near sides */
+   if (!canvas->cells || r <= 0)
+      return;
+   oled_pos_t l = ((cx - r) >> OLED_SUB_BITS) - 1,
+       top = ((cy - r) >> OLED_SUB_BITS) - 1,
+       w = ((2 * r) >> OLED_SUB_BITS) + 4;
+   uint8_t inside = (l >= clip.l && top >= clip.t && l + w <= clip.r && top + w <= clip.b),
+       changed = 0;
+   void plot(oled_pos_t x, oled_pos_t y, uint8_t c) {
+      if (inside)
+         changed |= oled_cover(x, y, c, i);
+      else if (x >= clip.l && x < clip.r && y >= clip.t && y < clip.b && oled_cover(x, y, c, i))
+         oled_damage(x, y, 1, 1);
+   }
+   void pass(oled_pos_t ca, oled_pos_t cb, uint8_t across) {    /* step along a, plot either side of centre on b */
+      oled_pos_t r45 = (r * 181) >> 8;  /* r/sqrt(2) */
+      for (oled_pos_t p = (ca - r45 + OLED_SUB - 1) >> OLED_SUB_BITS; p * OLED_SUB <= ca + r45; p++)
+      {
+         int32_t dist = p * OLED_SUB - ca;
+         if (across && (dist == r45 || dist == -r45))
+            continue;           /* done by other pass */
+         int32_t s = oled_isqrt(((int64_t) r * r - dist * dist) << (16 - 2 * OLED_SUB_BITS));  /* 1/256 pixel */
+         for (int side = -1; side <= 1; side += 2)
+         {
+            int32_t q = (int32_t) cb * (1 << (8 - OLED_SUB_BITS)) + side * s;   /* 1/256 pixel */
+            uint8_t frac = q;
+            oled_pos_t n = q >> 8;
+            if (across)
+            {
+               plot(n, p, 255 - frac);
+               if (frac)
+                  plot(n + 1, p, frac);
+            } else
+            {
+               plot(p, n, 255 - frac);
+               if (frac)
+                  plot(p, n + 1, frac);
+            }
+         }
+      }
+   }
+   pass(cx, cy, 0);
+   pass(cy, cx, 1);
+   if (changed)
+      oled_damage(l, top, w, w);
+}
+
+void oled_scroll_region(oled_pos_t w, oled_pos_t h, oled_pos_t dx, oled_pos_t dy, oled_intensity_t fill)
+{                               /* move content of area by dx/dy, filling what is exposed */
+   oled_pos_t x,
+    y;
+   oled_draw(w, h, 0, 0, &x, &y);
+   if (!canvas->cells || !oled_clip(&clip, &x, &y, &w, &h, NULL, NULL))
+      return;
+   oled_pos_t cw = w - (dx < 0 ? -dx : dx),
+       ch = h - (dy < 0 ? -dy : dy);    /* what is kept */
+   if (cw <= 0 || ch <= 0)
+   {                            /* all exposed */
+      oled_area(x, y, w, h, fill);
+      return;
+   }
+#ifdef	CONFIG_OLED_SSD1331
+   if (!oled_accel_copy(x + (dx < 0 ? -dx : 0), y + (dy < 0 ? -dy : 0), cw, ch, dx, dy))
+#endif
+      oled_damage(x, y, w, h);
+   const oled_pos_t stride = canvas->w;
+   oled_cell_t *o = canvas->cells + y * stride + x;
+   if (!dx && w == stride)
+      memmove(o + (dy > 0 ? dy * stride : 0), o + (dy < 0 ? -dy * stride : 0), ch * stride * sizeof(oled_cell_t));     /* whole rows, one move */
+   else if (dy > 0)
+      for (oled_pos_t row = h - 1; row >= dy; row--)    /* down, so work up */
+         memmove(o + row * stride + (dx > 0 ? dx : 0), o + (row - dy) * stride + (dx < 0 ? -dx : 0), cw * sizeof(oled_cell_t));
+   else
+      for (oled_pos_t row = -dy; row < h; row++)
+         memmove(o + (row + dy) * stride + (dx > 0 ? dx : 0), o + row * stride + (dx < 0 ? -dx : 0), cw * sizeof(oled_cell_t));
+   /* exposed */
+   oled_pos_t top = (dy > 0 ? dy : 0),
+       bottom = (dy < 0 ? h + dy : h);  /* rows kept */
+   if (top)
+      oled_area(x, y, w, top, fill);
+   if (bottom < h)
+      oled_area(x, y + bottom, w, h - bottom, fill);
+   if (dx)
+      oled_area(dx > 0 ? x : x + w + dx, y + top, dx > 0 ? dx : -dx, bottom - top, fill);
+}
+
+void oled_icon16(oled_pos_t w, oled_pos_t h, const void *data)
+{                               /* Icon, 16 bit packed */
+   if (!data)
+      oled_fill(w, h, 0);       /* No icon */
+   else
+   {
+      oled_pos_t x,
+       y;
+      oled_draw(w, h, 0, 0, &x, &y);
+      oled_block16(x, y, w, h, data, 0);
+   }
+}
+
+void oled_blit565(oled_pos_t w, oled_pos_t h, const void *data)
+{                               /* Image, RGB565 in display byte order, clipped once and copied by row */
+   oled_pos_t x,
+    y,
+    dx,
+    dy;
+   oled_draw(w, h, 0, 0, &x, &y);
+   if (!canvas->cells || !data)
+      return;
+   oled_pos_t cw = w,
+       ch = h;
+   if (!oled_clip(&clip, &x, &y, &cw, &ch, &dx, &dy))
+      return;
+   oled_damage(x, y, cw, ch);
+   const uint8_t *s = (const uint8_t *) data + (dy * w + dx) * 2;
+   oled_cell_t *o = canvas->cells + y * canvas->w + x;
+   while (ch--)
+   {
+#if CONFIG_OLED_BPP == 16
+      memcpy(o, s, cw * sizeof(oled_cell_t));
+#else
+      for (oled_pos_t n = 0; n < cw; n++)
+         o[n] = oled_rgb565((s[n * 2] << 8) | s[n * 2 + 1]);
+#endif
+      o += canvas->w;
+      s += w * 2;
+   }
+}
+
+/* Compressed images, "q5" format, see tools/oledimage.c */
+typedef struct
+{
+   const uint8_t *p;            /* next byte */
+   uint16_t px;                 /* previous pixel, RGB565 */
+   uint16_t run;                /* repeats of px still to deliver */
+   uint16_t index[64];          /* recently seen pixels */
+} oled_q5_t;
+
+#define	Q5_HASH(px)	(((px) >> 11) * 3 + (((px) >> 5) & 63) * 5 + ((px) & 31) * 7)
+#define	Q5_RGB(r,g,b)	((((r) & 31) << 11) | (((g) & 63) << 5) | ((b) & 31))
+
+static int oled_q5_start(oled_q5_t * q, const void *data, oled_pos_t * wp, oled_pos_t * hp)
+{                               /* check header, set w/h, returns 0 if not a q5 image */
+   const uint8_t *p = data;
+   if (!p || p[0] != 'q' || p[1] != '5')
+      return 0;
+   *wp = (p[2] << 8) + p[3];
+   *hp = (p[4] << 8) + p[5];
+   memset(q, 0, sizeof(*q));
+   q->p = p + 6;
+   return 1;
+}
+
+static inline uint16_t oled_q5_next(oled_q5_t * q)
+{                               /* next pixel, RGB565 host order */
+   if (q->run)
+   {
+      q->run--;
+      return q->px;
+   }
+   uint16_t px = q->px;
+   uint8_t t = *q->p++;
+   if (t < 0x40)
+      px = q->index[t];         /* index */
+   else if (t < 0x80)
+   {                            /* run 1-64 */
+      q->run = (t & 0x3F);
+      return px;
+   } else if (t < 0xC0)
+   {                            /* small diff, -2 to 1 on each of r/g/b */
+      px = Q5_RGB((px >> 11) + ((t >> 4) & 3) - 2, (px >> 5) + ((t >> 2) & 3) - 2, px + (t & 3) - 2);
+   } else if (t < 0xE0)
+   {                            /* green diff -16 to 15, r/b diff relative to that -8 to 7 */
+      int8_t dg = (t & 0x1F) - 16;
+      uint8_t v = *q->p++;
+      px = Q5_RGB((px >> 11) + dg + (v >> 4) - 8, (px >> 5) + dg, px + dg + (v & 15) - 8);
+   } else if (t < 0xFF)
+   {                            /* run 65-8000 */
+      q->run = 64 + (((t & 0x1F) << 8) | *q->p++);
+      return px;
+   } else
+   {                            /* literal */
+      px = (q->p[0] << 8) | q->p[1];
+      q->p += 2;
+   }
+   q->index[Q5_HASH(px) & 63] = px;
+   return q->px = px;
+}
+
+void oled_image(const void *data)
+{                               /* Image, q5 compressed, decoded in to the frame buffer */
+   oled_q5_t q;
+   oled_pos_t w,
+    h,
+    x,
+    y,
+    dx,
+    dy;
+   if (!oled_q5_start(&q, data, &w, &h))
+      return;
+   oled_draw(w, h, 0, 0, &x, &y);
+   if (!canvas->cells)
+      return;
+   oled_pos_t cw = w,
+       ch = h;
+   if (!oled_clip(&clip, &x, &y, &cw, &ch, &dx, &dy))
+      return;
+   oled_damage(x, y, cw, ch);
+   for (int skip = dy * w; skip; skip--)
+      oled_q5_next(&q);
+   oled_cell_t *o = canvas->cells + y * canvas->w + x;
+   while (ch--)
+   {
+      oled_pos_t col = 0;
+      for (; col < dx; col++)
+         oled_q5_next(&q);
+      for (oled_pos_t n = 0; n < cw; n++)
+         o[n] = oled_rgb565(oled_q5_next(&q));
+      for (col += cw; col < w; col++)
+         oled_q5_next(&q);
+      o += canvas->w;
+   }
+}
+
+/* canvases */
+static void *oled_arena_alloc(size_t len)
+{                               /* allocate from arena */
+   len = (len + 3) & ~3;
+   if (!oled_arena || oled_arena_used + len > CONFIG_OLED_ARENA)
+      return NULL;
+   void *p = oled_arena + oled_arena_used;
+   oled_arena_used += len;
+   return p;
+}
+
+static void oled_arena_free(void *p)
+{                               /* free back to p, i.e. p and anything allocated since */
+   if ((uint8_t *) p >= oled_arena && (uint8_t *) p < oled_arena + oled_arena_used)
+      oled_arena_used = (uint8_t *) p - oled_arena;
+}
+
+oled_canvas_t *oled_canvas(oled_pos_t w, oled_pos_t h)
+{                               /* Make a canvas */
+   if (w <= 0 || h <= 0)
+      return NULL;
+   oled_canvas_t *c = oled_arena_alloc(sizeof(*c) + w * h * sizeof(oled_cell_t));
+   if (!c)
+      return NULL;
+   c->cells = (void *) (c + 1);
+   c->w = w;
+   c->h = h;
+   c->layer = 0;
+   memset(c->cells, 0, w * h * sizeof(oled_cell_t));
+   return c;
+}
+
+void oled_layer_key(uint8_t n, char key)
+{                               /* Set transparent colour of a layer */
+   if (!n || n >= CONFIG_OLED_LAYERS || !oled_layers[n].cells)
+      return;
+   oled_canvas_t *was = canvas;
+   canvas = &oled_layers[n];
+   canvas->key = oled_rgb(oled_colour_lookup(key) * IMAX);
+   oled_damage(0, 0, canvas->w, canvas->h);
+   canvas = was;
+}
+
+void oled_canvas_free(oled_canvas_t * c)
+{                               /* Free a canvas, and anything allocated after it */
+   if (!c || c->layer)
+      return;
+   if (!canvas->layer && (uint8_t *) canvas >= (uint8_t *) c)
+      oled_select(NULL);        /* selected canvas is c or allocated after it */
+   oled_arena_free(c);
+}
+
+void oled_canvas_blit(const oled_canvas_t * c, char key)
+{                               /* Draw a canvas, cells matching key colour are not drawn */
+   if (!c)
+      return;
+   oled_pos_t x,
+    y,
+    dx,
+    dy;
+   oled_draw(c->w, c->h, 0, 0, &x, &y);
+   if (!canvas->cells || !c->cells || c == canvas)
+      return;
+   oled_pos_t cw = c->w,
+       ch = c->h;
+   if (!oled_clip(&clip, &x, &y, &cw, &ch, &dx, &dy))
+      return;
+   oled_damage(x, y, cw, ch);
+   const oled_cell_t *s = c->cells + dy * c->w + dx;
+   oled_cell_t *o = canvas->cells + y * canvas->w + x;
+   if (!key)
+   {                            /* opaque */
+      while (ch--)
+      {
+         memcpy(o, s, cw * sizeof(oled_cell_t));
+         o += canvas->w;
+         s += c->w;
+      }
+   } else
+   {                            /* colour key */
+      oled_cell_t k = oled_rgb(oled_colour_lookup(key) * IMAX);
+      while (ch--)
+      {
+         for (oled_pos_t n = 0; n < cw; n++)
+            if (!oled_same(s[n], k))
+               o[n] = s[n];
+         o += canvas->w;
+         s += c->w;
+      }
+   }
+}
+
+/* saved regions */
+struct oled_region_s
+{                               /* saved area of a canvas */
+   oled_canvas_t *c;            /* canvas it came from */
+   oled_pos_t x,
+    y,
+    w,
+    h;                          /* area, clipped */
+   oled_cell_t cells[];
+};
+
+oled_region_t *oled_save_region(oled_pos_t w, oled_pos_t h)
+{                               /* Save an area for later restore */
+   oled_pos_t x,
+    y;
+   oled_draw(w, h, 0, 0, &x, &y);
+   if (!canvas->cells || !oled_clip(&clip, &x, &y, &w, &h, NULL, NULL))
+      return NULL;
+   oled_region_t *r = oled_arena_alloc(sizeof(*r) + w * h * sizeof(oled_cell_t));
+   if (!r)
+      return NULL;
+   r->c = canvas;
+   r->x = x;
+   r->y = y;
+   r->w = w;
+   r->h = h;
+   const oled_cell_t *s = canvas->cells + y * canvas->w + x;
+   oled_cell_t *o = r->cells;
+   while (h--)
+   {
+      memcpy(o, s, w * sizeof(oled_cell_t));
+      o += w;
+      s += canvas->w;
+   }
+   return r;
+}
+
+void oled_restore_region(oled_region_t * r)
+{                               /* Put back a saved area, and free it (and anything allocated after it) */
+   if (!r)
+      return;
+   oled_canvas_t *was = canvas;
+   canvas = r->c;
+   oled_damage(r->x, r->y, r->w, r->h);
+   const oled_cell_t *s = r->cells;
+   oled_cell_t *o = canvas->cells + r->y * canvas->w + r->x;
+   for (oled_pos_t n = 0; n < r->h; n++)
+   {
+      memcpy(o, s, r->w * sizeof(oled_cell_t));
+      o += canvas->w;
+      s += r->w;
+   }
+   canvas = was;
+   oled_arena_free(r);
+}
+
+/* strip charts */
+struct oled_chart_s
+{                               /* chart, newest sample on right */
+   oled_canvas_t *c;            /* canvas it is on */
+   oled_pos_t x,
+    y,
+    w,
+    h;                          /* area */
+   int32_t lo,
+       hi;                      /* values at bottom and top */
+   oled_pos_t head;             /* next entry in ring */
+   struct
+   {                            /* pixel rows of sample, or -1 for none */
+      oled_pos_t v,
+       min,
+       max;
+   } s[];                       /* ring of w samples */
+};
+
+static oled_pos_t oled_chart_row(oled_chart_t * chart, int32_t v)
+{                               /* value to pixel row */
+   if (v <= chart->lo)
+      return chart->h - 1;
+   if (v >= chart->hi)
+      return 0;
+   return chart->h - 1 - ((int64_t) v - chart->lo) * (chart->h - 1) / ((int64_t) chart->hi - chart->lo);
+}
+
+static void oled_chart_column(oled_chart_t * chart, oled_pos_t col, int n)
+{                               /* draw sample n at column */
+   oled_pos_t min = chart->s[n].min,
+       max = chart->s[n].max,
+       v = chart->s[n].v;
+   for (oled_pos_t row = 0; row < chart->h; row++)
+      oled_pixel(chart->x + col, chart->y + row, row == v ? 255 : row <= min && row >= max ? 0x60 : 0);
+}
+
+oled_chart_t *oled_chart(oled_pos_t w, oled_pos_t h, int32_t lo, int32_t hi)
+{                               /* Make a strip chart at position */
+   if (w <= 0 || h <= 1 || hi <= lo)
+      return NULL;
+   oled_pos_t x,
+    y;
+   oled_draw(w, h, 0, 0, &x, &y);
+   oled_chart_t *chart = oled_arena_alloc(sizeof(*chart) + w * sizeof(*chart->s));
+   if (!chart)
+      return NULL;
+   chart->c = canvas;
+   chart->x = x;
+   chart->y = y;
+   chart->w = w;
+   chart->h = h;
+   chart->lo = lo;
+   chart->hi = hi;
+   chart->head = 0;
+   for (int n = 0; n < w; n++)
+      chart->s[n].v = chart->s[n].min = chart->s[n].max = -1;
+   return chart;
+}
+
+void oled_chart_draw(oled_chart_t * chart)
+{                               /* Draw whole chart */
+   if (!chart)
+      return;
+   oled_canvas_t *was = canvas;
+   oled_rect_t wasclip = clip;
+   uint8_t wasn = oled_clipn,
+       wast = t;
+   const uint8_t (*wasd)[4] = d;
+   if (chart->c != canvas)
+   {                            /* the clip is for the selected canvas, so all of another one */
+      canvas = chart->c;
+      oled_unclip();
+   }
+   t = 0;                       /* columns are drawn whole, background and all */
+   d = oled_nodither;
+   for (oled_pos_t col = 0; col < chart->w; col++)
+      oled_chart_column(chart, col, (chart->head + col) % chart->w);
+   canvas = was;
+   clip = wasclip;
+   oled_clipn = wasn;
+   t = wast;
+   d = wasd;
+}
+
+void oled_chart_push(oled_chart_t * chart, int32_t v, int32_t min, int32_t max)
+{                               /* Add a sample, scrolling chart left and drawing just the new column */
+   if (!chart)
+      return;
+   int n = chart->head;
+   chart->s[n].v = oled_chart_row(chart, v);
+   chart->s[n].min = oled_chart_row(chart, min);
+   chart->s[n].max = oled_chart_row(chart, max);
+   if (++chart->head == chart->w)
+      chart->head = 0;
+   oled_canvas_t *was = canvas;
+   oled_pos_t wasx = x,
+       wasy = y;
+   oled_align_t wasa = a;
+   oled_rect_t wasclip = clip;
+   uint8_t wasn = oled_clipn,
+       wast = t;
+   const uint8_t (*wasd)[4] = d;
+   if (chart->c != canvas)
+   {                            /* the clip is for the selected canvas, so all of another one */
+      canvas = chart->c;
+      oled_unclip();
+   }
+   t = 0;                       /* a transparent fill of 0 would leave the column scrolled out */
+   d = oled_nodither;
+   oled_pos(chart->x, chart->y, OLED_L | OLED_T);
+   oled_scroll_region(chart->w, chart->h, -1, 0, 0);
+   oled_chart_column(chart, chart->w - 1, n);
+   canvas = was;
+   clip = wasclip;
+   oled_clipn = wasn;
+   t = wast;
+   d = wasd;
+   x = wasx;
+   y = wasy;
+   a = wasa;
+}
+
+void oled_text(int8_t size, const char *fmt, ...)
+{                               /* Size negative for descenders */
+   if (!oled)
+      return;
+   va_list ap;
+   char temp[VWIDTH / 4 + 2];
+   va_start(ap, fmt);
    vsnprintf(temp, sizeof(temp), fmt, ap);
    va_end(ap);
    int z = 7;                   /* effective height */
@@ -369,7 +2130,7 @@ void oled_text(int8_t size, const char *fmt, ...)
       z = 9;
    } else if (!size)
       z = 5;
-   if (size > sizeof(fonts) / sizeof(*fonts))
+   if (size > (int) (sizeof(fonts) / sizeof(*fonts)))
       size = sizeof(fonts) / sizeof(*fonts);
    if (!fonts[size])
       return;
@@ -406,15 +2167,12 @@ void oled_text(int8_t size, const char *fmt, ...)
    oled_draw(w, h, size ? : 1, size ? : 1, &x, &y);     /* starting point */
    if (!w)
       return;                   /* nothing to print */
-   for (oled_pos_t n = -1; n <= w; n++)
-   {
-      oled_pixel(x + n, y - 1, 0);
-      oled_pixel(x + n, y + h, 0);
-   }
-   for (oled_pos_t n = 0; n < h; n++)
-   {
-      oled_pixel(x - 1, y + n, 0);
-      oled_pixel(x + w, y + n, 0);
+   if (!t)
+   {                            /* background border, not needed if transparent */
+      oled_hline(x - 1, x + w, y - 1, 0);
+      oled_hline(x - 1, x + w, y + h, 0);
+      oled_vline(x - 1, y, y + h - 1, 0);
+      oled_vline(x + w, y, y + h - 1, 0);
    }
    for (char *p = temp; *p; p++)
    {
@@ -432,71 +2190,710 @@ void oled_text(int8_t size, const char *fmt, ...)
    }
 }
 
-static esp_err_t oled_cmd(uint8_t cmd)
-{                               /* Send command */
-   gpio_set_level(oled_dc, 0);
+#ifdef	CONFIG_OLED_SSD1331
+static esp_err_t oled_cmds(int len, const uint8_t * cmd)
+{                               /* Send a command and its args to selected panel, SSD1331 args are sent as commands */
+   gpio_set_level(panel->dc, 0);
+   spi_transaction_t t = {
+      .length = 8 * len,
+      .tx_buffer = cmd,
+   };
+   return spi_device_polling_transmit(panel->spi, &t);
+}
+#endif
+
+static esp_err_t oled_cmdn(uint8_t cmd, int len, uint8_t a, uint8_t b, uint8_t c)
+{                               /* Send a command with len args, to all ready panels if none selected */
+   if (!panel)
+   {
+      esp_err_t e = 0;
+      for (int n = 0; n < oled_npanels; n++)
+         if (oled_panels[n].ready)
+         {
+            panel = &oled_panels[n];
+            e |= oled_cmdn(cmd, len, a, b, c);
+         }
+      panel = NULL;
+      return e;
+   }
+#ifdef	CONFIG_OLED_SSD1331
+   uint8_t s[4] = { cmd, a, b, c };
+   return oled_cmds(len + 1, s);
+#else
+   gpio_set_level(panel->dc, 0);
    spi_transaction_t t = {
       .length = 8,
       .tx_data = { cmd },
       .flags = SPI_TRANS_USE_TXDATA,
    };
-   esp_err_t e = spi_device_polling_transmit(oled_spi, &t);
-   return e;
-}
-
-static esp_err_t oled_data(int len, void *data)
-{                               /* Send data */
-   gpio_set_level(oled_dc, 1);
-   spi_transaction_t c = {
+   esp_err_t e = spi_device_polling_transmit(panel->spi, &t);
+   if (e || !len)
+      return e;
+   gpio_set_level(panel->dc, 1);
+   spi_transaction_t d = {
       .length = 8 * len,
-      .tx_buffer = data,
+      .tx_data = { a, b, c },
+      .flags = SPI_TRANS_USE_TXDATA,
    };
-   return spi_device_transmit(oled_spi, &c);
+   return spi_device_polling_transmit(panel->spi, &d);
+#endif
+}
+
+static esp_err_t oled_cmd(uint8_t cmd)
+{                               /* Send command */
+   return oled_cmdn(cmd, 0, 0, 0, 0);
 }
 
 static esp_err_t oled_cmd1(uint8_t cmd, uint8_t a)
 {                               /* Send a command with an arg */
-   esp_err_t e = oled_cmd(cmd);
-   if (e)
-      return e;
-   gpio_set_level(oled_dc, 1);
-   spi_transaction_t d = {
-      .length = 8,
-      .tx_data = { a },
-      .flags = SPI_TRANS_USE_TXDATA,
-   };
-   return spi_device_polling_transmit(oled_spi, &d);
+   return oled_cmdn(cmd, 1, a, 0, 0);
 }
 
 static esp_err_t oled_cmd2(uint8_t cmd, uint8_t a, uint8_t b)
 {                               /* Send a command with args */
-   esp_err_t e = oled_cmd(cmd);
-   if (e)
-      return e;
-   gpio_set_level(oled_dc, 1);
-   spi_transaction_t d = {
-      .length = 16,
-      .tx_data = { a, b },
-      .flags = SPI_TRANS_USE_TXDATA,
-   };
-   return spi_device_polling_transmit(oled_spi, &d);
+   return oled_cmdn(cmd, 2, a, b, 0);
 }
 
-#if 0
 static esp_err_t oled_cmd3(uint8_t cmd, uint8_t a, uint8_t b, uint8_t c)
 {                               /* Send a command with args */
-   esp_err_t e = oled_cmd(cmd);
-   if (e)
-      return e;
-   gpio_set_level(oled_dc, 1);
-   spi_transaction_t d = {
-      .length = 24,
-      .tx_data = { a, b, c },
-      .flags = SPI_TRANS_USE_TXDATA,
-   };
-   return spi_device_polling_transmit(oled_spi, &d);
+   return oled_cmdn(cmd, 3, a, b, c);
+}
+
+static esp_err_t oled_data(int len, void *data)
+{                               /* Send data to selected panel, in chunks, so other devices can use the bus in between */
+   oled_stat.bytes += len;
+   gpio_set_level(panel->dc, 1);
+   esp_err_t e = 0;
+   while (len && !e)
+   {
+      int n = (oled_chunk && len > oled_chunk ? oled_chunk : len);
+      spi_transaction_t c = {
+         .length = 8 * n,
+         .tx_buffer = data,
+      };
+      int64_t start = esp_timer_get_time();
+      e = spi_device_transmit(panel->spi, &c);
+      uint32_t took = esp_timer_get_time() - start;
+      if (took > oled_stat.chunk_us)
+         oled_stat.chunk_us = took;
+      oled_stat.chunks++;
+      data = (uint8_t *) data + n;
+      len -= n;
+      if (len)
+         taskYIELD();           /* display carries on writing RAM after the next chunk */
+   }
+   return e;
+}
+
+static void oled_window(oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_pos_t h)
+{                               /* set selected panel window, x/y on panel, w/h not past display RAM end, and start writing */
+   if (oled_rotated & 1)
+   {                            /* vertical address increment, so frame buffer rows go down display RAM columns */
+      oled_cmd2(0x15, COL_OFFSET + y, COL_OFFSET + y + h - 1);
+      oled_cmd2(0x75, x, x + w - 1);
+   } else
+   {
+      uint8_t g = (oled_gram_top + y) % GRAM_ROWS;
+      oled_cmd2(0x15, COL_OFFSET + x, COL_OFFSET + x + w - 1);
+      oled_cmd2(0x75, g, g + h - 1);
+   }
+#ifndef	CONFIG_OLED_SSD1331
+   oled_cmd(0x5C);              /* SSD1331 takes data straight after the window */
+#endif
+}
+
+static void oled_wait(oled_panel_t * p)
+{                               /* wait for data queued for a panel to go */
+   if (!p->busy)
+      return;
+   spi_transaction_t *r;
+   spi_device_get_trans_result(p->spi, &r, portMAX_DELAY);
+   uint32_t took = esp_timer_get_time() - p->start;
+   if (took > oled_stat.chunk_us)
+      oled_stat.chunk_us = took;
+   p->busy = 0;
+}
+
+static void oled_push(void)
+{                               /* send each panel's area a chunk at a time, so panels on different SPI hosts send at the same time */
+   uint8_t more = 1;
+   while (more)
+   {
+      more = 0;
+      for (int n = 0; n < oled_npanels; n++)
+      {
+         oled_panel_t *p = &oled_panels[n];
+         oled_wait(p);
+         if (!p->sh)
+            continue;
+         more = 1;
+         for (int m = 0; m < oled_npanels; m++)
+            if (oled_panels[m].dc == p->dc)
+               oled_wait(&oled_panels[m]);      /* shared DC */
+         panel = p;
+         if (!p->rows)
+         {                      /* window, up to where display RAM wraps */
+            oled_pos_t y = p->sy - oled_shown_y - p->y,
+                wrap = GRAM_ROWS - (oled_gram_top + y) % GRAM_ROWS;
+            p->rows = (p->sh < wrap ? p->sh : wrap);
+            oled_window(p->sx - oled_shown_x - p->x, y, p->sw, p->rows);
+         }
+         const oled_cell_t *o = oled + p->sy * VWIDTH + p->sx;
+         uint8_t direct = (CONFIG_OLED_LAYERS == 1 && p->sw == VWIDTH);       /* whole rows, straight from frame buffer */
+         int max = oled_chunk / (int) sizeof(oled_cell_t);      /* cells per transaction */
+         if (oled_chunk && !max)
+            max = 1;
+         if (!direct && (!max || max > (int) (sizeof(oled_buf) / sizeof(*oled_buf))))
+            max = sizeof(oled_buf) / sizeof(*oled_buf);
+         int rows = (max ? max / p->sw : p->rows),
+             cells = p->sw;     /* of each row */
+         if (rows > p->rows)
+            rows = p->rows;
+         if (p->part || rows < 1)
+         {                      /* chunk is less than a row, so part of one */
+            rows = 1;
+            cells = p->sw - p->part;
+            if (cells > max)
+               cells = max;
+         }
+         o += p->part;
+         if (direct)
+            p->t.tx_buffer = o;
+         else
+         {                      /* gathered, and layers composed */
+            for (int r = 0; r < rows; r++)
+            {
+               oled_cell_t *b = p->buf + r * cells;
+               const oled_cell_t *f = o + r * VWIDTH;
+               memcpy(b, f, cells * sizeof(oled_cell_t));
+               for (int l = 1; l < CONFIG_OLED_LAYERS; l++)
+               {                /* layers above, where not key colour */
+                  const oled_cell_t *s = oled_layers[l].cells + (f - oled),
+                      k = oled_layers[l].key;
+                  for (oled_pos_t i = 0; i < cells; i++)
+                     if (!oled_same(s[i], k))
+                        b[i] = s[i];
+               }
+            }
+            p->t.tx_buffer = p->buf;
+         }
+         int len = rows * cells * sizeof(oled_cell_t);
+         p->t.length = 8 * len;
+         oled_stat.bytes += len;
+         oled_stat.chunks++;
+         gpio_set_level(p->dc, 1);
+         p->start = esp_timer_get_time();
+         if (!spi_device_queue_trans(p->spi, &p->t, portMAX_DELAY))
+            p->busy = 1;
+         if (cells < p->sw && (p->part += cells) < p->sw)
+            continue;           /* rest of the row next time */
+         p->part = 0;
+         p->sy += rows;
+         p->sh -= rows;
+         p->rows -= rows;
+      }
+   }
+   panel = NULL;
+}
+
+static void oled_panel_area(oled_panel_t * p, oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_pos_t h)
+{                               /* set area of frame buffer for a panel to send, the part it shows, none if w or h is 0 */
+   oled_rect_t r = {.l = oled_shown_x + p->x,.t = oled_shown_y + p->y };
+   r.r = r.l + CONFIG_OLED_WIDTH;
+   r.b = r.t + CONFIG_OLED_HEIGHT;
+   p->sx = x;
+   p->sy = y;
+   p->sw = w;
+   p->sh = h;
+   p->rows = 0;
+   p->part = 0;
+   if (!p->ready || !oled_clip(&r, &p->sx, &p->sy, &p->sw, &p->sh, NULL, NULL))
+      p->sh = 0;
+}
+
+static void oled_send(oled_pos_t x, oled_pos_t y, oled_pos_t w, oled_pos_t h)
+{                               /* send area of frame buffer, within viewport, to the panels showing it */
+   for (int n = 0; n < oled_npanels; n++)
+      oled_panel_area(&oled_panels[n], x, y, w, h);
+   oled_push();
+}
+
+#ifdef	CONFIG_OLED_SSD1331
+static void oled_accel_send(void)
+{                               /* send queued controller drawing, in order, to the panels showing it, before any pixel data */
+   for (int q = 0; q < oled_accels; q++)
+   {
+      oled_accel_t *a = &oled_accel[q];
+      uint16_t v = ntohs(a->c);
+      for (int n = 0; n < oled_npanels; n++)
+      {
+         oled_panel_t *p = &oled_panels[n];
+         oled_rect_t r = {.l = oled_shown_x + p->x,.t = oled_shown_y + p->y };
+         r.r = r.l + CONFIG_OLED_WIDTH;
+         r.b = r.t + CONFIG_OLED_HEIGHT;
+         oled_pos_t x = a->x,
+             y = a->y,
+             w = a->w,
+             h = a->h;
+         if (!p->ready || !oled_clip(&r, &x, &y, &w, &h, NULL, NULL))
+            continue;
+         panel = p;
+         x += COL_OFFSET - r.l;
+         y -= r.t;
+         while (h)
+         {                      /* up to where display RAM wraps */
+            uint8_t g = (oled_gram_top + y) % GRAM_ROWS;
+            oled_pos_t rows = (g + h > GRAM_ROWS ? GRAM_ROWS - g : h);
+            if (a->cmd == 0x23)
+            {
+               uint8_t c[] = { 0x23, x, g, x + w - 1, g + rows - 1, x + a->dx, g + a->dy };
+               oled_cmds(sizeof(c), c);
+            } else
+            {                   /* colours C, B, A are 6 bits, i.e. RGB565 red and blue shifted up */
+               uint8_t c[] = { a->cmd, x, g, x + w - 1, g + rows - 1, (v >> 10) & 0x3E, (v >> 5) & 0x3F, (v << 1) & 0x3E, (v >> 10) & 0x3E, (v >> 5) & 0x3F, (v << 1) & 0x3E };
+               oled_cmds(a->cmd == 0x21 ? 8 : 11, c);
+            }
+            usleep(ACCEL_US(w, rows));
+            y += rows;
+            h -= rows;
+         }
+      }
+   }
+   panel = NULL;
+   oled_accels = 0;
+}
+#endif
+
+static void oled_pan(void)
+{                               /* move display to requested viewport */
+   oled_pos_t dy = oled_view_y - oled_shown_y;
+   if (!(oled_rotated & 1) && oled_disp_h == CONFIG_OLED_HEIGHT && oled_view_x == oled_shown_x && dy > -CONFIG_OLED_HEIGHT && dy < CONFIG_OLED_HEIGHT)
+   {                            /* vertical, one row of panels, move the start line and send only the rows that are exposed */
+      oled_gram_top = (oled_gram_top + GRAM_ROWS + dy) % GRAM_ROWS;
+      oled_shown_y = oled_view_y;
+      oled_cmd1(0xA1, oled_gram_top);
+      if (dy > 0)
+         oled_send(oled_shown_x, oled_shown_y + CONFIG_OLED_HEIGHT - dy, oled_disp_w, dy);
+      else
+         oled_send(oled_shown_x, oled_shown_y, oled_disp_w, -dy);
+      return;
+   }
+   oled_shown_x = oled_view_x;
+   oled_shown_y = oled_view_y;
+#ifdef	CONFIG_OLED_SSD1331
+   oled_gram_differs = 0;
+#endif
+   oled_send(oled_shown_x, oled_shown_y, oled_disp_w, oled_disp_h);
+}
+
+static void oled_turn(void)
+{                               /* apply requested rotation, a half turn is just a remap unless the glass moves in display RAM, a quarter turn fills display RAM the other way so resend */
+   uint8_t col = COL_OFFSET,
+       row = ROW_OFFSET;
+   uint8_t resend = ((oled_rotation ^ oled_rotated) & 1);
+   oled_rotated = oled_rotation;
+   if (col != COL_OFFSET || row != ROW_OFFSET)
+      resend = 1;               /* off centre panel, what is shown is elsewhere in display RAM */
+   if (resend && oled_gram_top)
+   {                            /* start line is not used when rotated 90/270 */
+      oled_gram_top = 0;
+      oled_cmd1(0xA1, 0);
+   }
+   oled_cmd1(0xA0, oled_remap[oled_rotated]);
+   if (row != ROW_OFFSET)
+   {                            /* glass starts at another display RAM row */
+#ifndef	CONFIG_OLED_SSD1331
+      oled_cmd1(0xFD, 0xB1);    /* locked by default */
+#endif
+      oled_cmd1(0xA2, ROW_OFFSET);
+#ifndef	CONFIG_OLED_SSD1331
+      oled_cmd1(0xFD, 0xB0);
+#endif
+   }
+   if (resend)
+   {
+      oled_shown_x = oled_view_x;
+      oled_shown_y = oled_view_y;
+#ifdef	CONFIG_OLED_SSD1331
+      oled_gram_differs = 0;
+#endif
+      oled_send(oled_shown_x, oled_shown_y, oled_disp_w, oled_disp_h);
+   }
+}
+
+static void oled_registers(uint8_t regs)
+{                               /* send display registers, REG_ bits */
+#ifdef	CONFIG_OLED_SSD1331
+   if (regs & REG_CONTRAST)
+      oled_cmd1(0x87, oled_contrast >> 4);
+   if (regs & REG_CHANNEL)
+      for (int n = 0; n < 3; n++)
+         oled_cmd1(0x81 + n, oled_channel[n] * oled_level / 255);
+   if (regs & REG_PRECHARGE)
+   {                            /* voltage in bits 5:1, second pre-charge speed of each colour for the period */
+      oled_cmd1(0xBB, oled_precharge_v << 1);
+      for (int n = 0; n < 3; n++)
+         oled_cmd1(0x8A + n, oled_precharge_t << 4);
+   }
+   return;
+#endif
+   if (regs & REG_CONTRAST)
+      oled_cmd1(0xC7, oled_contrast >> 4);
+   if (regs & REG_PRECHARGE)
+      oled_cmd1(0xB6, oled_precharge_t);
+   if (regs & (REG_CHANNEL | REG_PRECHARGE))
+   {                            /* these are locked by default */
+      oled_cmd1(0xFD, 0xB1);
+      if (regs & REG_CHANNEL)
+         oled_cmd3(0xC1, oled_channel[0] * oled_level / 255, oled_channel[1] * oled_level / 255, oled_channel[2] * oled_level / 255);
+      if (regs & REG_PRECHARGE)
+         oled_cmd1(0xBB, oled_precharge_v);
+      oled_cmd1(0xFD, 0xB0);
+   }
+}
+
+static void oled_effects_start(uint8_t regs)
+{                               /* start effects requested by REG_ bits, mode before blink as oled_set_mode() drops a blink requested before it */
+   int64_t now = esp_timer_get_time();
+   if (regs & REG_FADE)
+   {
+      oled_fade_from = oled_level;
+      oled_fade_to = oled_fade_req;
+      oled_fade_start = now;
+      oled_fade_us = oled_fade_us_req;
+   }
+   if (regs & REG_MODE)
+   {
+      oled_blink_left = 0;
+      oled_mode = oled_mode_req;
+   }
+   if (regs & REG_BLINK)
+   {
+      oled_blink_mode = oled_blink_mode_req;
+      oled_blink_us = oled_blink_us_req;
+      oled_blink_next = now;
+      oled_blink_left = oled_blink_left_req;
+   }
+}
+
+static uint32_t oled_effects(void)
+{                               /* step effects, returns us to next step, 0 if none running */
+   int64_t now = esp_timer_get_time();
+   uint32_t wait = 0;
+   if (oled_fade_us)
+   {
+      uint8_t level = oled_fade_to;
+      int64_t gone = now - oled_fade_start;
+      if (gone < oled_fade_us)
+      {
+         level = oled_fade_from + ((int) oled_fade_to - oled_fade_from) * gone / oled_fade_us;
+         wait = EFFECT_STEP;
+      } else
+         oled_fade_us = 0;
+      if (level != oled_level)
+      {
+         oled_level = level;
+         oled_registers(REG_CHANNEL);
+      }
+   }
+   uint8_t mode = oled_mode;
+   if (oled_blink_left)
+   {
+      mode = oled_mode_shown;
+      if (now >= oled_blink_next)
+      {
+         mode = (mode == oled_mode ? oled_blink_mode : oled_mode);
+         oled_blink_next = now + oled_blink_us;
+         if (oled_blink_left > 0)
+            oled_blink_left--;
+      }
+      if (oled_blink_left)
+      {
+         uint32_t next = oled_blink_next - now;
+         if (!wait || next < wait)
+            wait = next;
+      }
+   }
+   if (mode != oled_mode_shown)
+      oled_cmd(MODE(oled_mode_shown = mode));
+   return wait;
+}
+
+static uint8_t oled_pending(void)
+{                               /* pixel changes to send */
+   if (oled_rotation != oled_rotated || oled_view_x != oled_shown_x || oled_view_y != oled_shown_y)
+      return 1;
+#ifdef	CONFIG_OLED_SSD1331
+   if (oled_accels)
+      return 1;
+#endif
+   for (int n = 0; n < CONFIG_OLED_LAYERS; n++)
+      if (oled_layers[n].dirty_r >= oled_layers[n].dirty_l)
+         return 1;
+   return 0;
+}
+
+static void oled_sent(int64_t start)
+{                               /* count an update sent since start, and set when the next can be sent */
+   int64_t busy = esp_timer_get_time() - start;
+   oled_due = start + oled_frame_us;
+   if (oled_due < start + busy * 100 / oled_duty)
+      oled_due = start + busy * 100 / oled_duty;
+   oled_stat.frames++;
+   oled_stat.busy_us += busy;
+}
+
+static uint8_t oled_merge(oled_rect_t * a, const oled_rect_t * b)
+{                               /* set a to the area covering a and b, if they overlap or that is no more to send than both, returns if merged */
+   uint8_t overlap = (a->l < b->r && b->l < a->r && a->t < b->b && b->t < a->b);
+   oled_rect_t u = *a;
+   if (b->l < u.l)
+      u.l = b->l;
+   if (b->t < u.t)
+      u.t = b->t;
+   if (b->r > u.r)
+      u.r = b->r;
+   if (b->b > u.b)
+      u.b = b->b;
+   if (!overlap && (int32_t) (u.r - u.l) * (u.b - u.t) > (int32_t) (a->r - a->l) * (a->b - a->t) + (int32_t) (b->r - b->l) * (b->b - b->t))
+      return 0;
+   *a = u;
+   return 1;
+}
+
+static void oled_flush(void)
+{                               /* send what has changed */
+#ifdef	CONFIG_OLED_SSD1331
+   if (oled_rotation != oled_rotated || oled_view_x != oled_shown_x || oled_view_y != oled_shown_y)
+      oled_accel_drop();        /* display RAM is moving, so just send pixels */
+   else
+      oled_accel_send();
+#endif
+   if (oled_rotation != oled_rotated)
+      oled_turn();
+   if (oled_view_x != oled_shown_x || oled_view_y != oled_shown_y)
+      oled_pan();
+   const oled_rect_t v = {.l = oled_shown_x,.t = oled_shown_y,.r = oled_shown_x + oled_disp_w,.b = oled_shown_y + oled_disp_h };    /* viewport */
+   oled_rect_t d[CONFIG_OLED_LAYERS];   /* changed area of each layer, within viewport */
+   int nd = 0;
+   for (int n = 0; n < CONFIG_OLED_LAYERS; n++)
+   {
+      oled_canvas_t *c = &oled_layers[n];
+      if (c->dirty_r < c->dirty_l)
+         continue;
+      oled_pos_t x = c->dirty_l,
+          y = c->dirty_t,
+          w = c->dirty_r - c->dirty_l + 1,
+          h = c->dirty_b - c->dirty_t + 1;
+      oled_clean(c);
+      /* changes outside the viewport are sent if and when it moves to them */
+      if (oled_clip(&v, &x, &y, &w, &h, NULL, NULL))
+         d[nd++] = (oled_rect_t) {.l = x,.t = y,.r = x + w,.b = y + h };
+   }
+   for (int i = 0; i < nd; i++)
+      for (int j = i + 1; j < nd; j++)
+         if (oled_merge(&d[i], &d[j]))
+         {
+            d[j] = d[--nd];
+            i = -1;             /* merged area may now meet one already checked */
+            break;
+         }
+   for (int n = 0; n < nd; n++)
+   {                            /* send only the changed areas */
+      if (oled_npanels == 1)
+      {
+         oled_send(d[n].l, d[n].t, d[n].r - d[n].l, d[n].b - d[n].t);
+         continue;
+      }
+      for (int q = 0; q < oled_npanels; q++)
+      {                         /* each panel sends only its own changes, not the area covering changes on all of them */
+         oled_panel_t *p = &oled_panels[q];
+         oled_pos_t x = d[n].l,
+             y = d[n].t,
+             w = d[n].r - d[n].l,
+             h = d[n].b - d[n].t;
+         if (!oled_clip(&p->dirty, &x, &y, &w, &h, NULL, NULL))
+            h = 0;
+         oled_panel_area(p, x, y, w, h);
+      }
+      oled_push();
+   }
+   if (oled_npanels > 1)
+      for (int q = 0; q < oled_npanels; q++)
+         oled_panel_clean(&oled_panels[q]);
+}
+
+void oled_image_direct(const void *data)
+{                               /* Image, q5 compressed, decoded straight to the display */
+   oled_q5_t q;
+   oled_pos_t w,
+    h,
+    x,
+    y,
+    dx,
+    dy,
+    ox,
+    oy;
+   if (oled_asleep)
+   {                            /* nothing is sent while asleep, so draw it to be sent on wake */
+      oled_image(data);
+      return;
+   }
+   if (!oled_q5_start(&q, data, &w, &h))
+      return;
+   oled_draw(w, h, 0, 0, &x, &y);
+   if (!oled || !oled_locks)
+      return;
+   oled_pos_t iw = w,
+       ih = h;
+   if (!oled_clip(&clip, &x, &y, &iw, &ih, &ox, &oy))
+      return;                   /* ox/oy is the part of the image clipped off */
+   int64_t start = esp_timer_get_time();
+   if (oled_pending())
+      oled_flush();             /* earlier drawing goes first, not on top of the image later */
+#ifdef	CONFIG_OLED_SSD1331
+   oled_gram_differs = 1;
+#endif
+   x -= oled_shown_x;
+   y -= oled_shown_y;
+   for (int p = 0; p < oled_npanels; p++)
+   {                            /* each panel showing some of it */
+      panel = &oled_panels[p];
+      const oled_rect_t view = {.l = panel->x,.t = panel->y,.r = panel->x + CONFIG_OLED_WIDTH,.b = panel->y + CONFIG_OLED_HEIGHT };
+      oled_pos_t px = x,
+          py = y,
+          cw = iw,
+          ch = ih;
+      if (!panel->ready || !oled_clip(&view, &px, &py, &cw, &ch, &dx, &dy))
+         continue;
+      dx += ox;
+      dy += oy;
+      px -= panel->x;
+      py -= panel->y;
+      oled_q5_start(&q, data, &w, &h);
+      int n = 0;
+      oled_pos_t wrap = GRAM_ROWS - (oled_gram_top + py) % GRAM_ROWS;  /* rows before display RAM wraps */
+      oled_window(px, py, cw, ch < wrap ? ch : wrap);
+      for (int skip = dy * w; skip; skip--)
+         oled_q5_next(&q);
+      for (oled_pos_t row = 0; row < ch; row++)
+      {
+         if (row == wrap)
+         {                      /* rest at start of display RAM */
+            if (n)
+               oled_data(n * sizeof(*oled_buf), oled_buf);
+            n = 0;
+            oled_window(px, py + row, cw, ch - row);
+         }
+         for (oled_pos_t col = 0; col < w; col++)
+         {
+            uint16_t v = oled_q5_next(&q);
+            if (col < dx || col >= dx + cw)
+               continue;
+            oled_buf[n++] = oled_rgb565(v);
+            if (n == sizeof(oled_buf) / sizeof(*oled_buf))
+            {
+               oled_data(sizeof(oled_buf), oled_buf);
+               n = 0;
+            }
+         }
+      }
+      if (n)
+         oled_data(n * sizeof(*oled_buf), oled_buf);
+   }
+   panel = NULL;
+   oled_sent(start);            /* counts as an update, and towards the bus budget */
+}
+
+static void oled_power(void)
+{                               /* apply requested sleep, display RAM is kept */
+   if ((oled_asleep = oled_sleep_req))
+   {
+      oled_cmd(0xAE);
+#ifdef	CONFIG_OLED_SSD1331
+      oled_cmd1(0xB0, 0x1A);    /* power save */
+#elif defined(CONFIG_OLED_EXTERNAL_VDD)
+      oled_cmd1(0xAB, 0x00);    /* internal regulator off, only if VDD does not come from it */
+#endif
+   } else
+   {
+#ifdef	CONFIG_OLED_SSD1331
+      oled_cmd1(0xB0, 0x0B);
+#elif defined(CONFIG_OLED_EXTERNAL_VDD)
+      oled_cmd1(0xAB, 0x01);
+#endif
+      oled_cmd(0xAF);
+   }
+}
+
+static esp_err_t oled_init(void)
+{                               /* configure selected panel */
+#ifdef	CONFIG_OLED_SSD1331
+   esp_err_t e = oled_cmd(0xAE);        /* off while configuring */
+   e += oled_cmd1(0xA0, oled_remap[oled_rotated]);     /* rotation and colour mode */
+   e += oled_cmd1(0xA1, oled_gram_top); /* Start */
+   e += oled_cmd1(0xA2, ROW_OFFSET);    /* Offset, first row of glass */
+   e += oled_cmd1(0xA8, CONFIG_OLED_HEIGHT - 1);        /* MUX, rows of glass */
+   e += oled_cmd1(0xAD, 0x8E);  /* external VCC */
+   e += oled_cmd1(0x26, 0x01);  /* 0x22 rectangles are filled */
+   e += oled_cmd(0xAF);         /* start */
+   usleep(10000);
+   e += oled_cmd(0xA5);         /* white */
+#else
+   esp_err_t e = oled_cmd(0xAF);        /* start */
+   usleep(10000);
+   /* Many of these are setting as defaults, just to be sure */
+   e += oled_cmd(0xA5);         /* white */
+   e += oled_cmd1(0xA0, oled_remap[oled_rotated]);     /* rotation and colour mode */
+   e += oled_cmd1(0xFD, 0x12);  /* unlock */
+   e += oled_cmd1(0xFD, 0xB1);  /* unlock */
+   e += oled_cmd1(0xA1, oled_gram_top); /* Start */
+   e += oled_cmd1(0xA2, ROW_OFFSET);    /* Offset, first row of glass */
+   e += oled_cmd1(0xCA, CONFIG_OLED_HEIGHT - 1);        /* MUX, rows of glass */
+#if 0
+   e += oled_cmd1(0xB3, 0xF1);  /* Frequency */
+   e += oled_cmd1(0xAB, 0x01);  /* Regulator */
+   e += oled_cmd3(0xB4, 0xA0, 0xB5, 0x55);      /* VSL */
+   e += oled_cmd3(0xC1, 0xC8, 0x80, 0xC0);      /* Contrast */
+   e += oled_cmd1(0xC7, 0x0F);  /* current */
+   e += oled_cmd1(0xB1, 0x32);  /* clocks */
+   e += oled_cmd3(0xB2, 0xA4, 0x00, 0x00);      /* enhance */
+   e += oled_cmd1(0xBB, 0x17);  /* pre-charge voltage */
+   e += oled_cmd1(0xB6, 0x01);  /* pre-charge period */
+   e += oled_cmd1(0xBE, 0x05);  /* COM deselect voltage */
+#endif
+   e += oled_cmd1(0xFD, 0xB0);  /* lock */
+#endif
+   return e;
 }
+
+static void oled_ready(oled_panel_t * p)
+{                               /* configure a panel added after start up, and send what it shows */
+   panel = p;
+   oled_init();
+   oled_registers(REG_CONTRAST | REG_CHANNEL | REG_PRECHARGE);
+   oled_cmd(MODE(oled_mode_shown));
+   panel = NULL;
+#ifdef	CONFIG_OLED_SSD1331
+   oled_accel_drop();           /* the new panel is sent from the frame buffer */
 #endif
+   p->ready = 1;
+   oled_send(oled_shown_x + p->x, oled_shown_y + p->y, CONFIG_OLED_WIDTH, CONFIG_OLED_HEIGHT);
+}
+
+static void oled_free(void)
+{                               /* free frame buffer, layers and arena */
+   for (int n = 1; n < CONFIG_OLED_LAYERS; n++)
+   {
+      free(oled_layers[n].cells);
+      oled_layers[n].cells = NULL;
+   }
+   free(oled_arena);
+   oled_arena = NULL;
+   oled_arena_used = 0;
+   free(oled);
+   oled = oled_layers[0].cells = NULL;
+}
 
 static void oled_task(void *p)
 {
@@ -514,34 +2911,22 @@ static void oled_task(void *p)
          gpio_set_level(oled_rst, 1);
          usleep(1000);
       }
-      e = oled_cmd(0xAF);       /* start */
-      usleep(10000);
-      /* Many of these are setting as defaults, just to be sure */
-      e += oled_cmd(0xA5);      /* white */
-      e += oled_cmd1(0xA0, oled_flip ? 0x34 : 0x26);    /* flip and colour mode */
-      e += oled_cmd1(0xFD, 0x12);       /* unlock */
-      e += oled_cmd1(0xFD, 0xB1);       /* unlock */
-      e += oled_cmd1(0xA1, 0x00);       /* Start 0 */
-      e += oled_cmd1(0xA2, 0x00);       /* Offset 0 */
-#if 0
-      e += oled_cmd1(0xB3, 0xF1);       /* Frequency */
-      e += oled_cmd1(0xCA, 0x7F);       /* MUX */
-      e += oled_cmd1(0xAB, 0x01);       /* Regulator */
-      e += oled_cmd3(0xB4, 0xA0, 0xB5, 0x55);   /* VSL */
-      e += oled_cmd3(0xC1, 0xC8, 0x80, 0xC0);   /* Contrast */
-      e += oled_cmd1(0xC7, 0x0F);       /* current */
-      e += oled_cmd1(0xB1, 0x32);       /* clocks */
-      e += oled_cmd3(0xB2, 0xA4, 0x00, 0x00);   /* enhance */
-      e += oled_cmd1(0xBB, 0x17);       /* pre-charge voltage */
-      e += oled_cmd1(0xB6, 0x01);       /* pre-charge period */
-      e += oled_cmd1(0xBE, 0x05);       /* COM deselect voltage */
-#endif
-      e += oled_cmd1(0xFD, 0xB0);       /* lock */
-      oled_cmd2(0x15, 0, 127);
-      oled_cmd2(0x75, 0, 127);
-      oled_cmd(0x5C);
-      oled_data(OLEDSIZE, (void *) oled);
-      oled_cmd(0xA6);
+      oled_rotated = oled_rotation;
+      oled_gram_top = 0;
+      e = 0;
+      for (int n = 0; n < oled_npanels; n++)
+      {
+         panel = &oled_panels[n];
+         e += oled_init();
+         panel->ready = 1;
+      }
+      panel = NULL;
+      oled_send(oled_shown_x, oled_shown_y, oled_disp_w, oled_disp_h);
+      oled_cmd(MODE(oled_mode_shown = 0xA6));
+#ifdef	CONFIG_OLED_SSD1331
+      oled_accels = 0;          /* all sent as pixels */
+      oled_gram_differs = 0;
+#endif
       oled_unlock();
       if (!e)
          break;
@@ -550,35 +2935,103 @@ static void oled_task(void *p)
    if (e)
    {
       ESP_LOGE(TAG, "Configuration failed %s", esp_err_to_name(e));
-      free(oled);
-      oled = NULL;
+      oled_lock();
+      oled_task_id = NULL;      /* nothing to notify */
+      oled_free();
       oled_port = -1;
+      oled_unlock();
       vTaskDelete(NULL);
       return;
    }
-   oled_update = 1;
+   __atomic_fetch_or(&oled_regs, REG_CONTRAST, __ATOMIC_RELEASE);
+   uint32_t wait = 1;           /* us to next thing to do, 0 for wait to be told */
+   int64_t seen = 0;            /* when pixel changes were first seen, 0 for none */
+   uint8_t held = 0;            /* changes have been deferred */
    while (1)
-   {                            /* Update */
-      if (!oled_changed)
-      {
-         usleep(100000);
-         continue;
-      }
+   {                            /* Update, when told, or when an effect or held changes are due */
+      ulTaskNotifyTake(pdTRUE, wait ? (pdMS_TO_TICKS((wait + 999) / 1000) ? : 1) : portMAX_DELAY);
       oled_lock();
       oled_changed = 0;
-      oled_cmd2(0x15, 0, 127);
-      oled_cmd2(0x75, 0, 127);
-      oled_cmd(0x5C);
-      oled_data(OLEDSIZE, (void *) oled);
-      if (oled_update)
+      wait = 0;
+      if (oled_sleep_req != oled_asleep)
+         oled_power();
+      if (!oled_asleep)
+         for (int n = 0; n < oled_npanels; n++)
+            if (!oled_panels[n].ready)
+               oled_ready(&oled_panels[n]);
+      if (!oled_asleep && oled_pending())
+      {
+         int64_t now = esp_timer_get_time();
+         if (!seen)
+            seen = now;
+         if (now < oled_due && !held)
+         {                      /* frame rate or bus budget */
+            held = 1;
+            oled_stat.deferred++;
+         }
+         int64_t when = seen + oled_latency_us;
+         if (when < oled_due)
+            when = oled_due;
+         if (now < when)
+            wait = when - now;
+         else
+         {
+            oled_flush();
+            oled_sent(now);
+            seen = 0;
+            held = 0;
+         }
+      }
+      if (oled_regs)
+      {                         /* register only changes and effects, no pixel data */
+         uint8_t regs = __atomic_exchange_n(&oled_regs, 0, __ATOMIC_ACQUIRE);
+         oled_effects_start(regs);
+         oled_registers(regs);
+      }
+      if (!oled_asleep)
       {
-         oled_update = 0;
-         oled_cmd1(0xC7, oled_contrast >> 4);
+         uint32_t next = oled_effects();
+         if (next && (!wait || next < wait))
+            wait = next;
       }
       oled_unlock();
    }
 }
 
+static const char *oled_host(int8_t port, int8_t clk, int8_t din, int8_t cs)
+{                               /* set up an SPI host */
+   spi_bus_config_t config = {
+      .mosi_io_num = din,
+      .miso_io_num = -1,
+      .sclk_io_num = clk,
+      .quadwp_io_num = -1,
+      .quadhd_io_num = -1,
+      .max_transfer_sz = BUS_MAX,
+      .flags = SPICOMMON_BUSFLAG_MASTER,
+   };
+   if (port == HSPI_HOST && din == 22 && clk == 18 && cs == 5)
+      config.flags |= SPICOMMON_BUSFLAG_IOMUX_PINS;
+   if (spi_bus_initialize(port, &config, 2))
+      return "Init?";
+   return NULL;
+}
+
+static const char *oled_device(oled_panel_t * p, int8_t port, int8_t cs, int8_t dc)
+{                               /* add a panel on an SPI host */
+   spi_device_interface_config_t devcfg = {
+      .clock_speed_hz = SPI_MASTER_FREQ_20M | SPI_DEVICE_3WIRE,
+      .mode = 0,
+      .spics_io_num = cs,
+      .queue_size = 1,
+   };
+   if (spi_bus_add_device(port, &devcfg, &p->spi))
+      return "Add?";
+   gpio_set_direction(dc, GPIO_MODE_OUTPUT);
+   p->port = port;
+   p->dc = dc;
+   return NULL;
+}
+
 const char *oled_start(int8_t port, int8_t cs, int8_t clk, int8_t din, int8_t dc, int8_t rst, int8_t flip)
 {                               /* Start OLED task and display */
    if (din < 0 || !GPIO_IS_VALID_OUTPUT_GPIO(din))
@@ -593,43 +3046,127 @@ const char *oled_start(int8_t port, int8_t cs, int8_t clk, int8_t din, int8_t dc
       return "Bad port";
    if (rst >= 0 && !GPIO_IS_VALID_OUTPUT_GPIO(rst))
       return "RST?";
+   if (CONFIG_OLED_COL_OFFSET + CONFIG_OLED_WIDTH > GRAM_COLS || CONFIG_OLED_ROW_OFFSET + CONFIG_OLED_HEIGHT > GRAM_ROWS)
+      return "Size?";
+   const char *fail(const char *e) {    /* free what has been allocated */
+      oled_free();
+      return e;
+   }
    oled_mutex = xSemaphoreCreateMutex();        /* Shared text access */
    oled = malloc(OLEDSIZE);
    if (!oled)
       return "Mem?";
    memset(oled, 0, OLEDSIZE);
-   oled_flip = flip;
+   for (int n = 0; n < CONFIG_OLED_LAYERS; n++)
+   {
+      oled_canvas_t *c = &oled_layers[n];
+      if (n && !(c->cells = malloc(OLEDSIZE)))
+         return fail("Mem?");
+      if (n)
+         memset(c->cells, 0, OLEDSIZE); /* i.e. key, black */
+      c->w = VWIDTH;
+      c->h = VHEIGHT;
+      c->layer = 1;
+      oled_clean(c);
+   }
+   oled_layers[0].cells = oled;
+   if (CONFIG_OLED_ARENA && !(oled_arena = malloc(CONFIG_OLED_ARENA)))
+      return fail("Mem?");
+   oled_rotation = (flip ? 2 : 0);
    oled_port = port;
-   oled_dc = dc;
    oled_rst = rst;
-   spi_bus_config_t config = {
-      .mosi_io_num = din,
-      .miso_io_num = -1,
-      .sclk_io_num = clk,
-      .quadwp_io_num = -1,
-      .quadhd_io_num = -1,
-      .max_transfer_sz = 8 * (OLEDSIZE + 8),
-      .flags = SPICOMMON_BUSFLAG_MASTER,
-   };
-   if (port == HSPI_HOST && din == 22 && clk == 18 && cs == 5)
-      config.flags |= SPICOMMON_BUSFLAG_IOMUX_PINS;
-   if (spi_bus_initialize(port, &config, 2))
-      return "Init?";
-   spi_device_interface_config_t devcfg = {
-      .clock_speed_hz = SPI_MASTER_FREQ_20M | SPI_DEVICE_3WIRE,
-      .mode = 0,
-      .spics_io_num = cs,
-      .queue_size = 1,
-   };
-   if (spi_bus_add_device(port, &devcfg, &oled_spi))
-      return "Add?";
-   gpio_set_direction(dc, GPIO_MODE_OUTPUT);
+   const char *err = oled_host(port, clk, din, cs);
+   if (err)
+      return fail(err);
+   oled_panel_t *p = &oled_panels[0];
+   p->buf = oled_buf;
+   oled_panel_clean(p);
+   if ((err = oled_device(p, port, cs, dc)))
+      return fail(err);
+   oled_npanels = 1;
    if (rst >= 0)
       gpio_set_direction(rst, GPIO_MODE_OUTPUT);
-   xTaskCreate(oled_task, "OLED", 8 * 1024, NULL, 2, &oled_task_id);
+   xTaskCreate(oled_task, "OLED", 8 * 1024, NULL, CONFIG_OLED_PRIORITY, &oled_task_id);
+   return NULL;
+}
+
+const char *oled_panel(int8_t port, int8_t cs, int8_t clk, int8_t din, int8_t dc, oled_pos_t x, oled_pos_t y)
+{                               /* Add a panel showing the viewport at x/y */
+   if (!oled)
+      return "Not started";
+   if (oled_npanels == CONFIG_OLED_PANELS)
+      return "Too many";
+   if (dc < 0 || !GPIO_IS_VALID_OUTPUT_GPIO(dc))
+      return "DC?";
+   if (cs < 0 || !GPIO_IS_VALID_OUTPUT_GPIO(cs))
+      return "CS?";
+   if (port != SPI2_HOST && port != SPI3_HOST)
+      return "Bad port";
+   if (x < 0 || y < 0 || x + CONFIG_OLED_WIDTH > VWIDTH || y + CONFIG_OLED_HEIGHT > VHEIGHT)
+      return "Position?";
+   if (oled_rotation || oled_rotated)
+      return "Rotated";         /* requested, or not yet turned back */
+   if (oled_view_x > VWIDTH - x - CONFIG_OLED_WIDTH || oled_shown_x > VWIDTH - x - CONFIG_OLED_WIDTH || oled_view_y > VHEIGHT - y - CONFIG_OLED_HEIGHT || oled_shown_y > VHEIGHT - y - CONFIG_OLED_HEIGHT)
+      return "Viewport?";       /* panned too far for the frame buffer to cover this panel */
+   int n = 0;
+   while (n < oled_npanels && oled_panels[n].port != port)
+      n++;
+   uint8_t host = (n == oled_npanels);  /* new host */
+   if (host)
+   {
+      if (din < 0 || !GPIO_IS_VALID_OUTPUT_GPIO(din))
+         return "DIN?";
+      if (clk < 0 || !GPIO_IS_VALID_OUTPUT_GPIO(clk))
+         return "CLK?";
+      const char *err = oled_host(port, clk, din, cs);
+      if (err)
+         return err;
+   }
+   const char *fail(const char *e) {    /* free a host set up for this panel */
+      if (host)
+         spi_bus_free(port);
+      return e;
+   }
+   oled_panel_t *p = &oled_panels[oled_npanels];
+   if (!p->buf && !(p->buf = heap_caps_malloc(sizeof(oled_buf), MALLOC_CAP_DMA)))
+      return fail("Mem?");
+   const char *err = oled_device(p, port, cs, dc);
+   if (err)
+      return fail(err);
+   p->x = x;
+   p->y = y;
+   oled_panel_clean(p);
+   if (x + CONFIG_OLED_WIDTH > oled_disp_w)
+      oled_disp_w = x + CONFIG_OLED_WIDTH;
+   if (y + CONFIG_OLED_HEIGHT > oled_disp_h)
+      oled_disp_h = y + CONFIG_OLED_HEIGHT;
+   if (oled_npanels == 1)
+      for (int l = 0; l < CONFIG_OLED_LAYERS; l++)
+      {                         /* first panel has not been tracking its own damage, so give it what is not yet sent */
+         oled_canvas_t *c = &oled_layers[l];
+         if (c->dirty_r >= c->dirty_l)
+            oled_panel_damage(c->dirty_l, c->dirty_t, c->dirty_r - c->dirty_l + 1, c->dirty_b - c->dirty_t + 1);
+      }
+   oled_npanels++;
+   oled_kick();
    return NULL;
 }
 
+void oled_viewport(oled_pos_t x, oled_pos_t y)
+{                               /* Set the part of the frame buffer that is displayed */
+   if (x > VWIDTH - oled_disp_w)
+      x = VWIDTH - oled_disp_w;
+   if (y > VHEIGHT - oled_disp_h)
+      y = VHEIGHT - oled_disp_h;
+   if (x < 0)
+      x = 0;
+   if (y < 0)
+      y = 0;
+   oled_view_x = x;
+   oled_view_y = y;
+   oled_kick();
+}
+
 void oled_lock(void)
 {                               /* Lock display task */
    if (oled_mutex)
@@ -638,6 +3175,9 @@ void oled_lock(void)
    /* preset state */
    oled_background('k');
    oled_colour('w');
+   oled_dither(0);
+   oled_transparent(0);
+   oled_select(NULL);
    oled_pos(0, 0, OLED_L | OLED_T | OLED_H);
 }
 
@@ -646,4 +3186,6 @@ void oled_unlock(void)
    oled_locks--;
    if (oled_mutex)
       xSemaphoreGive(oled_mutex);
+   if (oled_changed && oled_task_id)
+      xTaskNotifyGive(oled_task_id);
 }
@@ -0,0 +1,7 @@
+// Stand-in for ESP-IDF, just enough to build oled.c on the host for ssd1331check.c
+#pragma once
+#include "hal/spi_types.h"
+#define	GPIO_IS_VALID_OUTPUT_GPIO(n)	((n) >= 0 && (n) < 34)
+typedef enum { GPIO_MODE_OUTPUT = 2 } gpio_mode_t;
+esp_err_t gpio_set_level(int pin, uint32_t level);
+esp_err_t gpio_set_direction(int pin, gpio_mode_t mode);
@@ -0,0 +1,12 @@
+// Stand-in for ESP-IDF, just enough to build oled.c on the host for ssd1331check.c
+#pragma once
+#include "hal/spi_types.h"
+typedef struct
+{
+   int mosi_io_num, miso_io_num, sclk_io_num, quadwp_io_num, quadhd_io_num, max_transfer_sz;
+   uint32_t flags;
+} spi_bus_config_t;
+#define	SPICOMMON_BUSFLAG_MASTER	1
+#define	SPICOMMON_BUSFLAG_IOMUX_PINS	2
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t * config, int dma);
+esp_err_t spi_bus_free(spi_host_device_t host);
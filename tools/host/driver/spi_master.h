@@ -0,0 +1,27 @@
+// Stand-in for ESP-IDF, just enough to build oled.c on the host for ssd1331check.c
+#pragma once
+#include "driver/spi_common.h"
+#include "freertos/FreeRTOS.h"
+typedef struct spi_device_t *spi_device_handle_t;
+typedef struct
+{
+   uint32_t flags;
+   size_t length;
+   union
+   {
+      const void *tx_buffer;
+      uint8_t tx_data[4];
+   };
+} spi_transaction_t;
+#define	SPI_TRANS_USE_TXDATA	1
+#define	SPI_MASTER_FREQ_20M	20000000
+#define	SPI_DEVICE_3WIRE	(1<<2)
+typedef struct
+{
+   int mode, clock_speed_hz, spics_io_num, queue_size;
+} spi_device_interface_config_t;
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t * config, spi_device_handle_t * handle);
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t * t);
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t * t);
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t * t, TickType_t wait);
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t ** t, TickType_t wait);
@@ -0,0 +1,5 @@
+// Stand-in for ESP-IDF, just enough to build oled.c on the host for ssd1331check.c
+#pragma once
+#include <stdlib.h>
+#define	MALLOC_CAP_DMA	8
+#define	heap_caps_malloc(size, caps)	malloc(size)
@@ -0,0 +1,5 @@
+// Stand-in for ESP-IDF, just enough to build oled.c on the host for ssd1331check.c
+#pragma once
+#include "hal/spi_types.h"
+#define	ESP_LOGE(tag, fmt, ...)	fprintf(stderr, "%s: " fmt "\n", tag, ##__VA_ARGS__)
+const char *esp_err_to_name(esp_err_t e);
@@ -0,0 +1,4 @@
+// Stand-in for ESP-IDF, just enough to build oled.c on the host for ssd1331check.c
+#pragma once
+#include <stdint.h>
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,9 @@
+// Stand-in for ESP-IDF, just enough to build oled.c on the host for ssd1331check.c
+#pragma once
+#include <stdint.h>
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+#define	portMAX_DELAY	0xFFFFFFFFUL
+#define	pdTRUE	1
+#define	pdMS_TO_TICKS(ms)	((TickType_t)((ms) / 10))
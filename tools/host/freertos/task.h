@@ -0,0 +1,10 @@
+// Stand-in for ESP-IDF, just enough to build oled.c on the host for ssd1331check.c
+#pragma once
+#include "freertos/FreeRTOS.h"
+typedef void *TaskHandle_t;
+BaseType_t xTaskCreate(void (*task)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t * handle);
+void vTaskDelete(TaskHandle_t task);
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+void taskYIELD(void);
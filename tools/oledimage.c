@@ -0,0 +1,188 @@
+// Make image data for oled_image() / oled_blit565() from a PPM
+// Copyright © 2019-21 Adrian Kennard Andrews & Arnold Ltd
+//
+// Build on the host: cc -O -o oledimage oledimage.c
+// e.g. convert picture.png ppm:- | oledimage picture > picture.h
+//
+// Default output is "q5" compressed for oled_image()/oled_image_direct(), -r is raw RGB565 for oled_blit565()
+//
+// q5 format: 'q', '5', width (2 bytes), height (2 bytes), then pixels as RGB565, left to right, top to bottom, coded as
+// 00iiiiii             index in to 64 recently seen pixels, hashed (r*3+g*5+b*7)&63
+// 01nnnnnn             repeat previous pixel n+1 times
+// 10rrggbb             previous pixel with r/g/b changed by -2 to 1 (value+2)
+// 110ggggg rrrrbbbb    previous pixel with g changed by -16 to 15 (value+16), and r/b by g change plus -8 to 7 (value+8)
+// 111nnnnn nnnnnnnn    repeat previous pixel n+65 times (n up to 7935)
+// 11111111 RGB565      literal pixel, big endian
+// Changes wrap in the 5/6/5 bit components. The previous pixel starts as 0 (black), and all index entries start as 0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define	HASH(px)	((((px) >> 11) * 3 + (((px) >> 5) & 63) * 5 + ((px) & 31) * 7) & 63)
+
+static uint8_t *out = NULL;
+static size_t len = 0,
+    max = 0;
+
+static void put(uint8_t v)
+{
+   if (len == max && !(out = realloc(out, max += 65536)))
+   {
+      fprintf(stderr, "Memory\n");
+      exit(1);
+   }
+   out[len++] = v;
+}
+
+static void run(unsigned n)
+{                               /* output repeat count */
+   while (n > 64)
+   {
+      unsigned l = n - 65;
+      if (l > 7935)
+         l = 7935;
+      put(0xE0 | (l >> 8));
+      put(l);
+      n -= l + 65;
+   }
+   if (n)
+      put(0x40 | (n - 1));
+}
+
+static int wrap(int d, int bits)
+{                               /* signed difference in a bits wide component */
+   d &= (1 << bits) - 1;
+   if (d >= (1 << (bits - 1)))
+      d -= (1 << bits);
+   return d;
+}
+
+static void encode(const uint16_t * px, int n)
+{
+   uint16_t index[64] = { 0 };
+   uint16_t prev = 0;
+   unsigned r = 0;
+   while (n--)
+   {
+      uint16_t p = *px++;
+      if (p == prev)
+      {
+         r++;
+         continue;
+      }
+      run(r);
+      r = 0;
+      int h = HASH(p);
+      if (index[h] == p)
+         put(h);
+      else
+      {
+         int dr = wrap((p >> 11) - (prev >> 11), 5),
+             dg = wrap((p >> 5) - (prev >> 5), 6),
+             db = wrap(p - prev, 5);
+         if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+            put(0x80 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+         else if (dg >= -16 && dg <= 15 && dr - dg >= -8 && dr - dg <= 7 && db - dg >= -8 && db - dg <= 7)
+         {
+            put(0xC0 | (dg + 16));
+            put(((dr - dg + 8) << 4) | (db - dg + 8));
+         } else
+         {
+            put(0xFF);
+            put(p >> 8);
+            put(p);
+         }
+         index[h] = p;
+      }
+      prev = p;
+   }
+   run(r);
+}
+
+static int number(FILE * f)
+{                               /* PPM header number */
+   int c,
+    v = 0;
+   while ((c = fgetc(f)) == '#' || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+      if (c == '#')
+         while ((c = fgetc(f)) != EOF && c != '\n');
+   if (c < '0' || c > '9')
+      return -1;
+   while (c >= '0' && c <= '9')
+   {
+      v = v * 10 + c - '0';
+      c = fgetc(f);
+   }
+   return v;
+}
+
+int main(int argc, char *argv[])
+{
+   int raw = 0,
+       c;
+   while ((c = getopt(argc, argv, "r")) != -1)
+      if (c == 'r')
+         raw = 1;
+      else
+      {
+         fprintf(stderr, "Usage: %s [-r] name < image.ppm > name.h\n", argv[0]);
+         return 1;
+      }
+   const char *name = (optind < argc ? argv[optind] : "image");
+   if (fgetc(stdin) != 'P' || fgetc(stdin) != '6')
+   {
+      fprintf(stderr, "Expecting binary PPM (P6)\n");
+      return 1;
+   }
+   int w = number(stdin),
+       h = number(stdin),
+       m = number(stdin);
+   if (w <= 0 || h <= 0 || w > 65535 || h > 65535 || m <= 0 || m > 255)
+   {
+      fprintf(stderr, "Bad PPM header\n");
+      return 1;
+   }
+   uint16_t *px = malloc(sizeof(*px) * w * h);
+   if (!px)
+   {
+      fprintf(stderr, "Memory\n");
+      return 1;
+   }
+   for (int n = 0; n < w * h; n++)
+   {
+      int r = fgetc(stdin),
+          g = fgetc(stdin),
+          b = fgetc(stdin);
+      if (b < 0)
+      {
+         fprintf(stderr, "Short PPM\n");
+         return 1;
+      }
+      px[n] = ((r * 31 + m / 2) / m << 11) | ((g * 63 + m / 2) / m << 5) | ((b * 31 + m / 2) / m);
+   }
+   if (raw)
+   {
+      for (int n = 0; n < w * h; n++)
+      {
+         put(px[n] >> 8);
+         put(px[n]);
+      }
+   } else
+   {
+      put('q');
+      put('5');
+      put(w >> 8);
+      put(w);
+      put(h >> 8);
+      put(h);
+      encode(px, w * h);
+   }
+   printf("const uint8_t %s[]={ // %d/%d %s (%zu bytes)\n", name, w, h, raw ? "RGB565" : "q5", len);
+   for (size_t n = 0; n < len; n++)
+      printf(" 0x%02x,%s", out[n], (n % 16 == 15 || n + 1 == len) ? "\n" : "");
+   printf("};\n");
+   return 0;
+}
@@ -0,0 +1,460 @@
+// Check the SSD1331 drawing commands used by oled.c against a model of the controller
+// Copyright © 2019-21 Adrian Kennard Andrews & Arnold Ltd
+//
+// Build on the host: cc -O -I host -I ../include -o ssd1331check ssd1331check.c && ./ssd1331check
+//
+// oled.c is built for a 96x64 SSD1331 against the stand-in ESP-IDF headers in host/, and the SPI traffic goes to a model of
+// the display RAM. The model handles the window (0x15/0x75), start line (0xA1), pixel data, and the 0x21 line, 0x22 rectangle
+// and 0x23 copy commands. After each update the display RAM shown must match the frame buffer.
+//
+// The datasheet does not say what 0x23 does when source and destination overlap, so the model copies a pixel at a time in
+// display RAM order, top to bottom and left to right, reading each source pixel as it goes. That is the worst case, a copy
+// down or right over itself repeats what it has just written.
+//
+// Exit status is the number of checks that failed.
+
+#define	CONFIG_OLED_SSD1331
+#define	CONFIG_OLED_WIDTH	96
+#define	CONFIG_OLED_HEIGHT	64
+#define	CONFIG_OLED_COL_OFFSET	0
+#define	CONFIG_OLED_ROW_OFFSET	0
+#define	CONFIG_OLED_VIRTUAL_WIDTH	96
+#define	CONFIG_OLED_VIRTUAL_HEIGHT	128
+#define	CONFIG_OLED_BPP	16
+#define	CONFIG_OLED_LAYERS	1
+#define	CONFIG_OLED_PANELS	1
+#define	CONFIG_OLED_ARENA	8192
+#define	CONFIG_OLED_FPS	50
+#define	CONFIG_OLED_LATENCY	0
+#define	CONFIG_OLED_BUS_DUTY	100
+#define	CONFIG_OLED_CHUNK	4096
+#define	CONFIG_OLED_PRIORITY	2
+#define	CONFIG_OLED_FONT1
+
+#include "../oled.c"
+
+/* the controller */
+static uint16_t gram[GRAM_ROWS][GRAM_COLS];     /* display RAM, RGB565 */
+static uint8_t start = 0;       /* 0xA1 start line */
+static uint8_t c0,
+ c1,
+ r0,
+ r1,
+ col,
+ row;                           /* window and write position */
+static uint8_t fill = 0;        /* 0x26 bit 0, rectangles are filled */
+static uint8_t cmd,
+ args[16],
+ nargs,
+ need;                          /* command being received */
+static uint8_t hi,
+ half = 0;                      /* first byte of a pixel */
+static int commands = 0;        /* 0x21-0x23 received */
+static long pixels = 0;         /* pixel data received */
+
+static int dc = -1;             /* DC pin of the panel */
+static int level[64];           /* GPIO levels */
+
+static uint16_t colour(const uint8_t * cba)
+{                               /* C, B, A (6 bits each) to RGB565 */
+   return ((cba[0] >> 1) << 11) | ((cba[1] & 63) << 5) | ((cba[2] >> 1) & 31);
+}
+
+static void plot(int x, int y, uint16_t v)
+{
+   if (x >= 0 && x < GRAM_COLS && y >= 0 && y < GRAM_ROWS)
+      gram[y][x] = v;
+}
+
+static int argcount(uint8_t c)
+{                               /* args for each command oled.c uses */
+   switch (c)
+   {
+   case 0x15:
+   case 0x75:
+      return 2;
+   case 0x21:
+      return 7;
+   case 0x22:
+      return 10;
+   case 0x23:
+      return 6;
+   case 0x26:
+   case 0x81:
+   case 0x82:
+   case 0x83:
+   case 0x87:
+   case 0x8A:
+   case 0x8B:
+   case 0x8C:
+   case 0xA0:
+   case 0xA1:
+   case 0xA2:
+   case 0xA8:
+   case 0xAD:
+   case 0xB0:
+   case 0xBB:
+      return 1;
+   }
+   return 0;
+}
+
+static void command(void)
+{                               /* a command with all its args */
+   uint8_t *a = args;
+   switch (cmd)
+   {
+   case 0x15:
+      col = c0 = a[0];
+      c1 = a[1];
+      break;
+   case 0x75:
+      row = r0 = a[0];
+      r1 = a[1];
+      break;
+   case 0xA1:
+      start = a[0];
+      break;
+   case 0x26:
+      fill = (a[0] & 1);
+      break;
+   case 0x21:
+      {                         /* line */
+         commands++;
+         int x = a[0],
+             y = a[1],
+             dx = abs(a[2] - x),
+             sx = (a[2] > x ? 1 : -1),
+             dy = -abs(a[3] - y),
+             sy = (a[3] > y ? 1 : -1),
+             err = dx + dy;
+         while (1)
+         {
+            plot(x, y, colour(a + 4));
+            if (x == a[2] && y == a[3])
+               break;
+            int e2 = 2 * err;
+            if (e2 >= dy)
+            {
+               err += dy;
+               x += sx;
+            }
+            if (e2 <= dx)
+            {
+               err += dx;
+               y += sy;
+            }
+         }
+         break;
+      }
+   case 0x22:                  /* rectangle, outline colour then fill colour */
+      commands++;
+      for (int y = a[1]; y <= a[3]; y++)
+         for (int x = a[0]; x <= a[2]; x++)
+            if (x == a[0] || x == a[2] || y == a[1] || y == a[3])
+               plot(x, y, colour(a + 4));
+            else if (fill)
+               plot(x, y, colour(a + 7));
+      break;
+   case 0x23:                  /* copy, in display RAM order, overlapping or not */
+      commands++;
+      for (int y = a[1]; y <= a[3]; y++)
+         for (int x = a[0]; x <= a[2]; x++)
+            plot(a[4] + x - a[0], a[5] + y - a[1], gram[y][x]);
+      break;
+   }
+}
+
+static void byte(int d, uint8_t v)
+{                               /* a byte from the SPI bus, d is the DC level */
+   if (!d)
+   {                            /* commands and their args */
+      if (need)
+      {
+         args[nargs++] = v;
+         if (nargs == need)
+         {
+            command();
+            need = 0;
+         }
+         return;
+      }
+      cmd = v;
+      nargs = 0;
+      if (!(need = argcount(v)))
+         command();
+      return;
+   }
+   if (!half)
+   {                            /* data, RGB565 big endian */
+      hi = v;
+      half = 1;
+      return;
+   }
+   half = 0;
+   pixels++;
+   plot(col, row, (hi << 8) | v);
+   if (++col > c1)
+   {
+      col = c0;
+      if (++row > r1)
+         row = r0;
+   }
+}
+
+/* stand-ins for ESP-IDF */
+struct spi_device_t
+{
+   int unused;
+};
+static struct spi_device_t device;
+
+static esp_err_t spi(spi_transaction_t * t)
+{
+   const uint8_t *p = (t->flags & SPI_TRANS_USE_TXDATA) ? t->tx_data : t->tx_buffer;
+   for (size_t n = 0; n < t->length / 8; n++)
+      byte(level[dc], p[n]);
+   return 0;
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t * config, int dma)
+{
+   return 0;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host)
+{
+   return 0;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t * config, spi_device_handle_t * handle)
+{
+   *handle = &device;
+   return 0;
+}
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t * t)
+{
+   return spi(t);
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t * t)
+{
+   return spi(t);
+}
+
+static spi_transaction_t *queued = NULL;
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t * t, TickType_t wait)
+{
+   queued = t;
+   return spi(t);
+}
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t ** t, TickType_t wait)
+{
+   *t = queued;
+   return 0;
+}
+
+esp_err_t gpio_set_level(int pin, uint32_t l)
+{
+   level[pin] = l;
+   return 0;
+}
+
+esp_err_t gpio_set_direction(int pin, gpio_mode_t mode)
+{
+   return 0;
+}
+
+const char *esp_err_to_name(esp_err_t e)
+{
+   return "error";
+}
+
+int64_t esp_timer_get_time(void)
+{
+   static int64_t now = 0;
+   return now += 10;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+   return NULL;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait)
+{
+   return 1;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+   return 1;
+}
+
+BaseType_t xTaskCreate(void (*task)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t priority, TaskHandle_t * handle)
+{                               /* not run, the checks do what the task would */
+   *handle = NULL;
+   return 1;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority)
+{
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+   return 1;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+   return 0;
+}
+
+void taskYIELD(void)
+{
+}
+
+/* checks */
+static int failed = 0;
+
+static void update(void)
+{                               /* what the update task does */
+   oled_lock();
+   if (oled_pending())
+      oled_flush();
+   oled_unlock();
+}
+
+static void check(const char *what)
+{                               /* display RAM shown matches the frame buffer */
+   update();
+   int bad = 0;
+   for (int y = 0; y < CONFIG_OLED_HEIGHT; y++)
+      for (int x = 0; x < CONFIG_OLED_WIDTH; x++)
+      {
+         uint16_t want = ntohs(oled[(oled_shown_y + y) * VWIDTH + oled_shown_x + x]),
+             got = gram[(start + y) % GRAM_ROWS][COL_OFFSET + x];
+         if (want != got && bad++ < 3)
+            printf("%s: %d,%d is %04X not %04X\n", what, x, y, got, want);
+      }
+   printf("%-16s %s, %d commands, %ld pixels sent\n", what, bad ? "FAILED" : "ok", commands, pixels);
+   if (bad)
+      failed++;
+   commands = 0;
+   pixels = 0;
+}
+
+static void scroll(const char *what, oled_pos_t dx, oled_pos_t dy)
+{                               /* scroll a patterned area both ways */
+   oled_lock();
+   oled_colour('K');
+   oled_pos(0, 0, OLED_L | OLED_T);
+   oled_fill(CONFIG_OLED_WIDTH, CONFIG_OLED_HEIGHT, 255);
+   for (int n = 0; n < 12; n++)
+   {                            /* stripes, so repeated rows or columns show */
+      oled_colour("RGBCMYW"[n % 7]);
+      oled_pos(10 + n * 3, 8 + n * 3, OLED_L | OLED_T);
+      oled_fill(3, 40 - n * 2, 255);
+   }
+   oled_unlock();
+   update();
+   commands = 0;
+   pixels = 0;
+   oled_lock();
+   oled_colour('B');
+   oled_pos(8, 6, OLED_L | OLED_T);
+   oled_scroll_region(60, 48, dx, dy, 255);
+   oled_unlock();
+   check(what);
+}
+
+int main(void)
+{
+   const char *e = oled_start(SPI2_HOST, 5, 18, 23, 16, -1, 0);
+   if (e)
+   {
+      printf("oled_start: %s\n", e);
+      return 1;
+   }
+   dc = 16;
+   oled_lock();
+   panel = &oled_panels[0];
+   oled_init();
+   panel->ready = 1;
+   panel = NULL;
+   oled_send(oled_shown_x, oled_shown_y, oled_disp_w, oled_disp_h);
+   oled_unlock();
+   check("start");
+
+   oled_lock();
+   oled_colour('G');
+   oled_pos(10, 10, OLED_L | OLED_T);
+   oled_fill(30, 20, 255);
+   oled_colour('R');
+   oled_pos(5, 5, OLED_L | OLED_T);
+   oled_box(50, 40, 255);
+   oled_unlock();
+   check("fill and box");
+
+   oled_lock();
+   oled_colour('C');
+   oled_pos(2, 50, OLED_L | OLED_T);
+   oled_text(1, "SSD1331");
+   oled_colour('Y');
+   oled_pos(60, 0, OLED_L | OLED_T);
+   oled_fill(20, 20, 255);
+   oled_unlock();
+   check("text and fill");
+
+   oled_lock();
+   oled_pos(0, 0, OLED_L | OLED_T);
+   oled_dither(1);
+   oled_fill(96, 64, 100);
+   oled_unlock();
+   check("dithered fill");
+
+   scroll("scroll left", -5, 0);
+   scroll("scroll right", 5, 0);
+   scroll("scroll up", 0, -4);
+   scroll("scroll down", 0, 4);
+   scroll("scroll up left", -3, -7);
+   scroll("scroll down right", 7, 3);
+   scroll("scroll down left", -2, 9);
+   scroll("scroll up right", 6, -1);
+   scroll("scroll down 1", 0, 1);
+   scroll("scroll right 1", 1, 0);
+   scroll("scroll past", 70, 0);
+
+   oled_lock();
+   oled_pos(0, 64, OLED_L | OLED_T);
+   oled_colour('M');
+   oled_fill(96, 64, 255);
+   oled_viewport(0, 40);
+   oled_unlock();
+   check("pan");
+   scroll("scroll panned", 0, 3);
+
+   oled_lock();
+   oled_pos(2, 70, OLED_L | OLED_T);
+   oled_colour('Y');
+   oled_chart_t *chart = oled_chart(90, 30, 0, 100);
+   oled_unlock();
+   for (int n = 0; n < 40; n++)
+   {
+      oled_lock();
+      oled_colour('Y');
+      oled_chart_push(chart, n * 13 % 100, n * 13 % 100 - 10, n * 13 % 100 + 10);
+      oled_unlock();
+      update();
+   }
+   check("chart");
+
+   return failed;
+}